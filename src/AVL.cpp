@@ -1,104 +1,397 @@
 #include "AVL.h"
 #include <iostream>
+#include <string>
 #include <vector>
-#include <regex>
+#include <algorithm>
+#include <functional>
+#include <fstream>
+#include <cstdlib>
+#include <future>
+#include <atomic>
 using namespace std;
 
+// Default constructor, used for the sentinel slot and released slots
+Node::Node()
+    : id(0), height(0), size(0), left(nullIndex), right(nullIndex) {}  // The sentinel has height 0 and size 0 like an empty subtree
+
 // Constructor definition for Node class
-Node::Node(string name, string id)
-    : name(name), id(id), height(1), left(nullptr), right(nullptr) {}  // Initialize node with name, id, height, and no children
+Node::Node(string name, uint32_t id)
+    : name(std::move(name)), id(id), height(1), size(1), left(nullIndex), right(nullIndex) {}  // Initialize node with name, id, height, size, and no children
 
+// Parse an 8-digit ID into its packed integer form; anything else is rejected
+bool parseId(string_view text, uint32_t& id) {
+    if (text.length() != 8) {
+        return false;  // IDs are always exactly 8 digits
+    }
+    uint32_t value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') {  // Not isdigit: a plain char above 0x7f is undefined behaviour there
+            return false;
+        }
+        value = value * 10 + (c - '0');  // 99999999 fits comfortably in 32 bits
+    }
+    id = value;
+    return true;
+}
+// Format a packed ID back into its zero-padded 8-digit form
+string formatId(uint32_t id) {
+    string text(8, '0');
+    for (int i = 7; i >= 0 && id != 0; i--) {
+        text[i] = static_cast<char>('0' + id % 10);
+        id /= 10;
+    }
+    return text;
+}
+// Pool constructor: slot 0 of the first chunk is reserved for the sentinel
+NodePool::NodePool()
+    : chunksAllocated(1), nodesAllocated(0), nodesReused(0), liveNodes(0), chunks(1), freeList(nullIndex) {
+    chunks[0].reserve(chunkSize);
+    chunks[0].emplace_back();
+}
+// Hand out a node slot, preferring recycled slots over fresh ones
+uint32_t NodePool::allocate(string name, uint32_t id) {
+    uint32_t index;
+    if (freeList != nullIndex) {
+        index = freeList;  // Reuse the most recently released slot
+        freeList = (*this)[index].left;
+        (*this)[index] = Node(std::move(name), id);
+        nodesReused++;
+    } else {
+        if (chunks.back().size() == chunkSize) {
+            chunks.emplace_back();  // Only the chunk handles move; the nodes stay where they are
+            chunksAllocated++;
+        }
+        vector<Node>& chunk = chunks.back();
+        if (chunk.capacity() < chunkSize) {
+            chunk.reserve(chunkSize);  // A new chunk, or the last chunk of a copied pool, which copies only what it needs
+        }
+        index = static_cast<uint32_t>(((chunks.size() - 1) << chunkShift) + chunk.size());
+        chunk.emplace_back(std::move(name), id);
+    }
+    nodesAllocated++;
+    liveNodes++;
+    return index;
+}
+// Reset a node and push its slot onto the free list
+void NodePool::release(uint32_t index) {
+    (*this)[index] = Node();  // Drops the name's storage
+    (*this)[index].left = freeList;
+    freeList = index;
+    liveNodes--;
+}
+// Start a traversal positioned on the first node of the given order
+TreeIterator::TreeIterator(const NodePool& pool, uint32_t root, TraversalOrder order)
+    : pool(&pool), order(order) {
+    if (order == TraversalOrder::Inorder) {
+        pushLeftSpine(root);
+    } else if (order == TraversalOrder::Preorder) {
+        if (root != nullIndex) {
+            stack.push_back(root);
+        }
+    } else {
+        pushFirstPostorder(root);
+    }
+}
+// Advance to the next node of the traversal
+void TreeIterator::next() {
+    uint32_t current = stack.back();
+    stack.pop_back();
+    const Node& n = (*pool)[current];
+    if (order == TraversalOrder::Inorder) {
+        pushLeftSpine(n.right);  // Everything in the right subtree comes before the ancestors
+    } else if (order == TraversalOrder::Preorder) {
+        // Children are visited left first, so the right child goes on the stack first
+        if (n.right != nullIndex) {
+            stack.push_back(n.right);
+        }
+        if (n.left != nullIndex) {
+            stack.push_back(n.left);
+        }
+    } else if (!stack.empty() && (*pool)[stack.back()].left == current) {
+        // Finished a left subtree: the parent's right subtree comes before the parent
+        pushFirstPostorder((*pool)[stack.back()].right);
+    }
+}
+// Reposition an inorder traversal on the first node with an ID >= id, in one descent.
+// The stack ends up holding exactly the ancestors whose ID is >= id, like a traversal that got there normally
+void TreeIterator::seekLowerBound(uint32_t root, uint32_t id) {
+    stack.clear();
+    uint32_t node = root;
+    while (node != nullIndex) {
+        const Node& n = (*pool)[node];
+        if (n.id >= id) {
+            stack.push_back(node);  // This node and its right subtree still lie ahead
+            node = n.left;
+        } else {
+            node = n.right;  // This node and its left subtree are all below the bound
+        }
+    }
+}
+// Reposition an inorder traversal on the node at position n by descending on subtree sizes.
+// Past the end, the traversal is simply done
+void TreeIterator::seekRank(uint32_t root, uint64_t n) {
+    stack.clear();
+    uint32_t node = root;
+    while (node != nullIndex) {
+        const Node& current = (*pool)[node];
+        uint32_t leftSize = (*pool)[current.left].size;
+        if (n <= leftSize) {
+            stack.push_back(node);  // The target is this node or in its left subtree, so this node is still ahead
+            if (n == leftSize) {
+                return;
+            }
+            node = current.left;
+        } else {
+            n -= leftSize + 1;
+            node = current.right;
+        }
+    }
+    stack.clear();  // n was past the last node
+}
+void TreeIterator::pushLeftSpine(uint32_t node) {
+    while (node != nullIndex) {
+        stack.push_back(node);
+        node = (*pool)[node].left;
+    }
+}
+void TreeIterator::pushFirstPostorder(uint32_t node) {
+    while (node != nullIndex) {
+        stack.push_back(node);
+        const Node& n = (*pool)[node];
+        node = n.left != nullIndex ? n.left : n.right;
+    }
+}
+// Sink constructor: nothing is written until the buffer is flushed
+OutputSink::OutputSink(ostream& target, size_t capacity)
+    : lineBuffered(false), target(&target), capacity(capacity) {
+    buffer.reserve(capacity);
+}
+// Anything still buffered goes out when the sink is destroyed
+OutputSink::~OutputSink() {
+    flush();
+}
+// Append text, handing the buffer to the target once it is full
+void OutputSink::write(string_view text) {
+    buffer.append(text.data(), text.size());
+    if (buffer.size() >= capacity) {
+        flush();
+    }
+}
+// Append text followed by a newline
+void OutputSink::writeLine(string_view text) {
+    buffer.append(text.data(), text.size());
+    buffer.push_back('\n');
+    if (lineBuffered || buffer.size() >= capacity) {
+        flush();
+    }
+}
+// Hand large, already formatted text straight to the target, after whatever is buffered, without copying it
+// into the buffer first
+void OutputSink::writeRaw(string_view text) {
+    if (!buffer.empty()) {
+        target->write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+    target->write(text.data(), text.size());
+    if (lineBuffered) {
+        target->flush();
+    }
+}
+// Write out everything buffered so far
+void OutputSink::flush() {
+    if (!buffer.empty()) {
+        target->write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+    target->flush();
+}
+// The sink every tree writes to unless it is pointed elsewhere
+OutputSink& standardOutput() {
+    static OutputSink sink(cout);
+    return sink;
+}
 // AVL constructor to initialize the root of the tree
 AVL::AVL() {
-    root = nullptr;  // Start with an empty tree
+    root = nullIndex;  // Start with an empty tree
+    out = &standardOutput();
+    threads = 1;
+    fingerValid = false;
 }
 // Get the balance factor of a node, which is the difference in height between the left and right children
-int Node::getBalanceFactor(Node* node) {
-    if (node == nullptr) {
+int AVL::getBalanceFactor(uint32_t node) {
+    if (node == nullIndex) {
         return 0;  // Null nodes have a balance factor of 0
     }
-    return nodeHeight(node->left) - nodeHeight(node->right);  // Difference between left and right subtree heights
+    return nodeHeight(pool[node].left) - nodeHeight(pool[node].right);  // Difference between left and right subtree heights
 }
 // Get the height of a node
-int Node::nodeHeight(Node* node) {
-    if (node == nullptr) {
-        return 0;  // Null nodes have height 0
-    }
-    return node->height;  // Return the node's stored height
+int AVL::nodeHeight(uint32_t node) {
+    return pool[node].height;  // The sentinel keeps height 0, so null children need no special case
+}
+// Get the number of nodes in a subtree
+int AVL::nodeSize(uint32_t node) {
+    return pool[node].size;  // The sentinel keeps size 0
 }
-// Update the height of a node after insertion, deletion, or rotation
-int Node::updateNodeHeight(Node* node) {
-    if (node == nullptr) {
+// Update the height (and subtree size) of a node after insertion, deletion, or rotation
+int AVL::updateNodeHeight(uint32_t node) {
+    if (node == nullIndex) {
         return 0;  // Null nodes have height 0
     }
     // Height is 1 plus the maximum height of the left and right children
-    node->height = 1 + std::max(nodeHeight(node->left), nodeHeight(node->right));
-    return node->height;
+    Node& n = pool[node];
+    int height = 1 + std::max(nodeHeight(n.left), nodeHeight(n.right));
+    if (height != n.height) {
+        countHeight(n.height, -1);  // Keep the height histogram in step
+        countHeight(height, 1);
+        n.height = height;
+    }
+    n.size = 1 + pool[n.left].size + pool[n.right].size;  // Rotations and removals refresh the size on the same path
+    return n.height;
+}
+// Allocate a leaf node and count it in the height histogram
+uint32_t AVL::createNode(string name, uint32_t id) {
+    countHeight(1, 1);
+    return pool.allocate(std::move(name), id);
+}
+// Return a node to the pool and drop it from the height histogram
+void AVL::releaseNode(uint32_t node) {
+    fingerValid = false;  // The last insert's path may run through this node
+    countHeight(pool[node].height, -1);
+    pool.release(node);
+}
+// The set-operation task running on this thread, if any. Its tasks share the tree, so they record
+// histogram changes in their own task instead of touching heightCounts
+static thread_local SetTask* currentTask = nullptr;
+// Adjust the number of nodes recorded at a height
+void AVL::countHeight(int height, int delta) {
+    if (currentTask != nullptr) {
+        vector<int64_t>& changes = currentTask->heightChanges;
+        if (changes.size() <= static_cast<size_t>(height)) {
+            changes.resize(height + 1);
+        }
+        changes[height] += delta;
+        return;
+    }
+    if (heightCounts.size() <= static_cast<size_t>(height)) {
+        heightCounts.resize(height + 1);
+    }
+    heightCounts[height] += delta;
+    while (!heightCounts.empty() && heightCounts.back() == 0) {
+        heightCounts.pop_back();  // The histogram ends at the tallest height present
+    }
 }
 // Perform a left rotation around the given node
-Node* AVL::rotateLeft(Node* node) {
-    Node* newParent = node->right;  // New parent becomes the right child
-    Node* grandChild = newParent->left;  // Save left child of the new parent
-    newParent->left = node;  // Perform rotation
-    node->right = grandChild;  // Reattach grandchild
+uint32_t AVL::rotateLeft(uint32_t node) {
+    uint32_t newParent = pool[node].right;  // New parent becomes the right child
+    uint32_t grandChild = pool[newParent].left;  // Save left child of the new parent
+    pool[newParent].left = node;  // Perform rotation
+    pool[node].right = grandChild;  // Reattach grandchild
     // Update heights after rotation
-    node->updateNodeHeight(node);
-    newParent->updateNodeHeight(newParent);
+    updateNodeHeight(node);
+    updateNodeHeight(newParent);
 
     return newParent;  // Return new root of this subtree
 }
 // Perform a right rotation around the given node
-Node* AVL::rotateRight(Node* node) {
-    Node* newParent = node->left;  // New parent becomes the left child
-    Node* grandChild = newParent->right;  // Save right child of the new parent
-    newParent->right = node;  // Perform rotation
-    node->left = grandChild;  // Reattach grandchild
+uint32_t AVL::rotateRight(uint32_t node) {
+    uint32_t newParent = pool[node].left;  // New parent becomes the left child
+    uint32_t grandChild = pool[newParent].right;  // Save right child of the new parent
+    pool[newParent].right = node;  // Perform rotation
+    pool[node].left = grandChild;  // Reattach grandchild
     // Update heights after rotation
-    node->updateNodeHeight(node);
-    newParent->updateNodeHeight(newParent);
+    updateNodeHeight(node);
+    updateNodeHeight(newParent);
 
     return newParent;  // Return new root of this subtree
 }
 // Perform a left-right rotation (double rotation)
-Node* AVL::rotateLeftRight(Node* node) {
-    node->left = rotateLeft(node->left);  // First perform left rotation on left child
+uint32_t AVL::rotateLeftRight(uint32_t node) {
+    uint32_t child = rotateLeft(pool[node].left);  // First perform left rotation on left child
+    pool[node].left = child;
     return rotateRight(node);  // Then perform right rotation
 }
 // Perform a right-left rotation (double rotation)
-Node* AVL::rotateRightLeft(Node* node) {
-    node->right = rotateRight(node->right);  // First perform right rotation on right child
+uint32_t AVL::rotateRightLeft(uint32_t node) {
+    uint32_t child = rotateRight(pool[node].right);  // First perform right rotation on right child
+    pool[node].right = child;
     return rotateLeft(node);  // Then perform left rotation
 }
 // Helper function to insert a node into the AVL tree
-void AVL::insertHelper(string id, string name) {
+void AVL::insertHelper(string_view id, string_view name) {
     bool flag = false;
+    uint32_t key = 0;
     // Validate the name (only alphabetic characters and spaces are allowed)
-    for (const char c : name) {
-        if (!isalpha(c) && c != ' ') {
-            cout << "unsuccessful" << endl;
-            return;
-        }
+    if (!validName(name)) {
+        out->writeLine("unsuccessful");
+        return;
     }
-    // Check if ID length is exactly 8 characters
-    if (id.length() != 8) {
-        cout << "unsuccessful" << endl;
+    // Check that the ID is exactly 8 digits
+    if (!parseId(id, key)) {
+        out->writeLine("unsuccessful");
         return;
     }
     // Insert the node, and handle duplicate IDs
-    this->root = insert(this->root, name, id, flag);
+    this->root = insert(this->root, name, key, flag);
     if (flag) {
-        cout << "unsuccessful" << endl;  // Duplicate ID case
+        out->writeLine("unsuccessful");  // Duplicate ID case
     } else {
-        cout << "successful" << endl;  // Successful insertion
+        out->writeLine("successful");  // Successful insertion
+    }
+}
+// Insert a run of (ID, name) commands in one pass: the valid ones are sorted, built into a balanced
+// tree and merged with the existing tree. Prints the same results, in the same order, as one insertHelper per entry
+void AVL::insertBatchHelper(const vector<pair<string_view, string_view>>& batch) {
+    vector<pair<uint32_t, size_t>> keys;  // (ID, position in the batch)
+    keys.reserve(batch.size());
+    for (size_t i = 0; i < batch.size(); i++) {
+        uint32_t key = 0;
+        if (validName(batch[i].second) && parseId(batch[i].first, key)) {
+            keys.emplace_back(key, i);
+        }
+    }
+    sort(keys.begin(), keys.end());  // Equal IDs stay in command order, so the first one wins
+    vector<uint32_t> nodes;
+    vector<size_t> owners;  // owners[k] = position of the command that created nodes[k]
+    for (size_t k = 0; k < keys.size(); k++) {
+        if (k > 0 && keys[k].first == keys[k - 1].first) {
+            continue;  // Duplicate of an earlier command in the batch
+        }
+        nodes.push_back(createNode(string(batch[keys[k].second].second), keys[k].first));
+        owners.push_back(keys[k].second);
+    }
+
+    SetTask task;
+    vector<uint32_t> copies = nodes;
+    uint32_t batchRoot = buildBalanced(nodes, 0, nodes.size());
+    currentTask = &task;
+    root = unionNodes(root, batchRoot, setOperationForks());  // Nodes whose ID is already in the tree are dropped
+    currentTask = nullptr;
+    finishSetOperation(task, copies);  // Leaves task.discarded sorted
+
+    vector<bool> inserted(batch.size(), false);
+    for (size_t k = 0; k < nodes.size(); k++) {
+        inserted[owners[k]] = !binary_search(task.discarded.begin(), task.discarded.end(), nodes[k]);
+    }
+    for (size_t i = 0; i < batch.size(); i++) {
+        out->writeLine(inserted[i] ? "successful" : "unsuccessful");
     }
 }
+// Names may only hold letters and spaces
+bool AVL::validName(string_view name) {
+    for (const char c : name) {
+        if (!isalpha(static_cast<unsigned char>(c)) && c != ' ') {
+            return false;
+        }
+    }
+    return true;
+}
 // Rebalance a node if it becomes unbalanced
-Node* AVL::rebalance(Node* node) {
-    int balance = node->getBalanceFactor(node);
+uint32_t AVL::rebalance(uint32_t node) {
+    int balance = getBalanceFactor(node);
     // Left-heavy (balance > 1)
     if (balance > 1) {
         // Left-left case
-        if (node->left != nullptr && node->left->getBalanceFactor(node->left) >= 0) {
+        if (getBalanceFactor(pool[node].left) >= 0) {
             return rotateRight(node);
         }
         // Left-right case
@@ -109,7 +402,7 @@ Node* AVL::rebalance(Node* node) {
     // Right-heavy (balance < -1)
     if (balance < -1) {
         // Right-right case
-        if (node->right != nullptr && node->right->getBalanceFactor(node->right) <= 0) {
+        if (getBalanceFactor(pool[node].right) <= 0) {
             return rotateLeft(node);
         }
         // Right-left case
@@ -119,152 +412,302 @@ Node* AVL::rebalance(Node* node) {
     }
 
     // Update height before returning the node
-    node->updateNodeHeight(node);
+    updateNodeHeight(node);
     return node;  // No rotation needed
 }
-// Insert a new node with the given name and ID, and flag duplicates
-Node* AVL::insert(Node* node, string name, string id, bool& flag) {
-    if (node == nullptr) {
-        flag = false;  // Insertion successful
-        return new Node(name, id);  // Create and return new node
-    }
-    // Recursively insert into left or right subtree based on the lexicographical order of ID
-    if (id > node->id) {
-        node->right = insert(node->right, name, id, flag);
-    } else if (id < node->id) {
-        node->left = insert(node->left, name, id, flag);
+// Insert a new node with the given name and ID, and flag duplicates.
+// Iterative: the descent is recorded on the path stack, and retracing stops as soon as a
+// subtree's height is unchanged (an insert needs at most one single or double rotation).
+// The name stays a view until the node is created, so it is copied exactly once
+uint32_t AVL::insert(uint32_t node, string_view name, uint32_t id, bool& flag) {
+    flag = false;
+    uint32_t current = node;
+    int64_t low = -1;               // Exclusive ID bounds of the subtree at current
+    int64_t high = int64_t(1) << 32;
+    if (fingerValid && !path.empty() && path[0] == node) {
+        // Finger search: climb the last insert's path to the deepest subtree whose bounds hold the ID.
+        // With increasing IDs that is the last node inserted, so the descent below is O(1); the retrace is not
+        while (path.size() > 1 && !(pathBounds.back().first < id && id < pathBounds.back().second)) {
+            path.pop_back();
+            pathBounds.pop_back();
+        }
+        current = path.back();
+        low = pathBounds.back().first;
+        high = pathBounds.back().second;
+        path.pop_back();  // Pushed again by the descent
+        pathBounds.pop_back();
     } else {
-        flag = true;  // Duplicate ID found
-        return node;  // No insertion for duplicates
+        path.clear();
+        pathBounds.clear();
     }
-    // Update node height after insertion
-    node->updateNodeHeight(node);
-    // Rebalance the node if necessary
-    return rebalance(node);
+    fingerValid = true;
+    while (current != nullIndex) {
+        if (id == pool[current].id) {
+            flag = true;  // Duplicate ID found
+            return node;  // No insertion for duplicates
+        }
+        path.push_back(current);
+        pathBounds.emplace_back(low, high);
+        if (id < pool[current].id) {
+            high = pool[current].id;
+            current = pool[current].left;
+        } else {
+            low = pool[current].id;
+            current = pool[current].right;
+        }
+    }
+    indexName(name, id);
+    uint32_t newNode = createNode(string(name), id);  // Create the new node; the string is moved into it
+    if (path.empty()) {
+        path.push_back(newNode);  // The subtree was empty
+        pathBounds.emplace_back(low, high);
+        return newNode;
+    }
+    uint32_t parent = path.back();
+    if (id < pool[parent].id) {
+        pool[parent].left = newNode;
+    } else {
+        pool[parent].right = newNode;
+    }
+    size_t depth = path.size();
+    node = retraceInsert(node);
+    if (path.size() == depth) {
+        path.push_back(newNode);  // No rotation, so the finger can point at the new node itself
+        pathBounds.emplace_back(low, high);
+    }
+    return node;
+}
+// Walk back up the recorded path after an insert, fixing heights and sizes and rotating where needed.
+// Heights settle within a few levels, but every ancestor's size grows, so this always climbs to the top
+uint32_t AVL::retraceInsert(uint32_t node) {
+    bool heightSettled = false;
+    for (size_t i = path.size(); i-- > 0;) {
+        uint32_t current = path[i];
+        if (heightSettled) {
+            pool[current].size++;  // Only the size still changes above this point
+            continue;
+        }
+        int oldHeight = pool[current].height;
+        updateNodeHeight(current);
+        if (abs(getBalanceFactor(current)) > 1) {
+            uint32_t subtree = rebalance(current);  // Restores the subtree's height from before the insert
+            node = replaceChild(i, current, subtree, node);
+            heightSettled = true;
+            path.resize(i);  // The path below the rotation no longer exists; the nodes above keep their bounds
+            pathBounds.resize(i);
+        } else if (pool[current].height == oldHeight) {
+            heightSettled = true;
+        }
+    }
+    return node;
+}
+// Point the parent of path[i] (or the subtree root) at a node that replaced path[i]
+uint32_t AVL::replaceChild(size_t i, uint32_t oldChild, uint32_t newChild, uint32_t subtreeRoot) {
+    if (i == 0) {
+        return newChild;  // The subtree root itself was replaced
+    }
+    uint32_t parent = path[i - 1];
+    if (pool[parent].left == oldChild) {
+        pool[parent].left = newChild;
+    } else {
+        pool[parent].right = newChild;
+    }
+    return subtreeRoot;
 }
 // Helper function to search for a node by ID
-void AVL::searchIdHelper(string id) {
+void AVL::searchIdHelper(string_view id) {
     bool flag = false;
+    uint32_t key = 0;
     // Validate ID (it must have exactly 8 digits)
-    if (id.length() != 8) {
-        cout << "unsuccessful" << endl;
+    if (!parseId(id, key)) {
+        out->writeLine("unsuccessful");
         return;
     }
-    for (char c : id) {
-        if (!isdigit(c)) {
-            cout << "unsuccessful" << endl;
-            return;
-        }
-    }
     // Start searching from the root
-    searchId(root, id, flag);
+    searchId(root, key, flag);
     if (!flag) {
-        cout << "unsuccessful" << endl;  // ID not found
+        out->writeLine("unsuccessful");  // ID not found
     }
 }
 // Search for a node by ID in the AVL tree
-void AVL::searchId(Node* node, string id, bool& flag) {
-    if (node == nullptr) {
+void AVL::searchId(uint32_t node, uint32_t id, bool& flag) {
+    if (node == nullIndex) {
         return;  // Base case: stop if node is null
     }
-    if (id == node->id) {
-        cout << node->name << endl;  // Print the name if ID matches
+    if (id == pool[node].id) {
+        out->writeLine(pool[node].name);  // Print the name if ID matches
         flag = true;  // Set flag to true (ID found)
         return;
     }
     // Recursively search in left or right subtree
-    if (id < node->id) {
-        searchId(node->left, id, flag);
+    if (id < pool[node].id) {
+        searchId(pool[node].left, id, flag);
     } else {
-        searchId(node->right, id, flag);
+        searchId(pool[node].right, id, flag);
     }
 }
 // Helper function to search for a node by name
-void AVL::searchNameHelper(string name) {
+void AVL::searchNameHelper(string_view name) {
     bool flag = false;
-    searchName(root, name, flag);
+    searchName(name, flag);
     if (!flag) {
-        cout << "unsuccessful" << endl;  // Name not found
+        out->writeLine("unsuccessful");  // Name not found
     }
 }
-// Search for a node by name in the AVL tree
-void AVL::searchName(Node* node, string name, bool& flag) {
-    if (node == nullptr) {
-        return;  // Stop if node is null
-    }
-    // If the name matches, print the ID and stop recursion
-    if (name == node->name) {
-        cout << node->id << endl;
+// Search for nodes by name through the name index, printing every matching ID in sorted order
+void AVL::searchName(string_view name, bool& flag) {
+    for (uint32_t id : idsNamed(name)) {
+        out->writeLine(formatId(id));
         flag = true;
-        return;
     }
-    // Continue searching both left and right subtrees
-    searchName(node->left, name, flag);
-    searchName(node->right, name, flag);
+}
+// Collect the IDs of every node with a name, in sorted order
+vector<uint32_t> AVL::idsNamed(string_view name) const {
+    auto entry = nameIndex.find(name);
+    if (entry == nameIndex.end()) {
+        return {};  // No node carries this name
+    }
+    return vector<uint32_t>(entry->second.begin(), entry->second.end());
+}
+// Record that the node with this ID carries this name
+void AVL::indexName(string_view name, uint32_t id) {
+    auto entry = nameIndex.find(name);
+    if (entry == nameIndex.end()) {
+        entry = nameIndex.emplace(string(name), set<uint32_t>()).first;  // The index keeps one copy per distinct name
+    }
+    entry->second.insert(id);  // O(log k) for a name held by k IDs
+}
+// Forget the name of a node that is being removed
+void AVL::unindexName(string_view name, uint32_t id) {
+    auto entry = nameIndex.find(name);
+    entry->second.erase(id);
+    if (entry->second.empty()) {
+        nameIndex.erase(entry);  // Don't keep entries for names that are gone
+    }
+}
+// Find the node holding an ID, or the sentinel if it is absent
+uint32_t AVL::findNode(uint32_t id) const {
+    uint32_t node = root;
+    while (node != nullIndex && pool[node].id != id) {
+        node = id < pool[node].id ? pool[node].left : pool[node].right;
+    }
+    return node;
 }
 // Helper function to remove a node by ID
-void AVL::removeHelper(string id) {
+void AVL::removeHelper(string_view id) {
     bool flag = false;
+    uint32_t key = 0;
     // Validate the ID (it must be exactly 8 digits)
-    if (id.length() != 8) {
-        cout << "unsuccessful" << endl;
+    if (!parseId(id, key)) {
+        out->writeLine("unsuccessful");
         return;
     }
     // Attempt to remove the node
-    this->root = removeNode(this->root, id, flag);
+    this->root = removeNode(this->root, key, flag);
     if (!flag) {
-        cout << "unsuccessful" << endl;
+        out->writeLine("unsuccessful");
     } else {
-        cout << "successful" << endl;
+        out->writeLine("successful");
     }
 }
 // Find the node with the smallest ID in a subtree
-Node* AVL::smallestNode(Node* node) {
-    Node* temp = node;
-    while (temp->left != nullptr) {
-        temp = temp->left;  // Keep moving left to find the smallest node
+uint32_t AVL::smallestNode(uint32_t node) {
+    uint32_t temp = node;
+    while (pool[temp].left != nullIndex) {
+        temp = pool[temp].left;  // Keep moving left to find the smallest node
     }
     return temp;
 }
-// Remove a node from the AVL tree
-Node* AVL::removeNode(Node* node, string id, bool& flag) {
-    if (node == nullptr) {
+// Remove a node from the AVL tree.
+// Iterative like insert: retracing stops once a subtree's height is unchanged
+uint32_t AVL::removeNode(uint32_t node, uint32_t id, bool& flag) {
+    fingerValid = false;  // The path is about to be reused for this removal
+    path.clear();
+    uint32_t current = node;
+    while (current != nullIndex && id != pool[current].id) {
+        path.push_back(current);
+        current = id < pool[current].id ? pool[current].left : pool[current].right;
+    }
+    if (current == nullIndex) {
         return node;  // Node not found
     }
-    if (id > node->id) {
-        node->right = removeNode(node->right, id, flag);  // Recur into the right subtree
-    } else if (id < node->id) {
-        node->left = removeNode(node->left, id, flag);  // Recur into the left subtree
-    } else {
-        flag = true;  // Node found
-        // Case 1: Node with no children (leaf)
-        if (node->left == nullptr && node->right == nullptr) {
-            delete node;
-            node = nullptr;
-        }
-        // Case 2: Node with one child (right child)
-        else if (node->left == nullptr) {
-            Node* temp = node;
-            node = node->right;
-            delete temp;
-        }
-        // Case 2: Node with one child (left child)
-        else if (node->right == nullptr) {
-            Node* temp = node;
-            node = node->left;
-            delete temp;
-        }
-        // Case 3: Node with two children
-        else {
-            Node* temp = smallestNode(node->right);  // Find inorder successor
-            node->id = temp->id;  // Replace node's ID with successor's ID
-            node->name = temp->name;  // Replace node's name with successor's name
-            node->right = removeNode(node->right, temp->id, flag);  // Remove the successor
+    flag = true;  // Node found
+    unindexName(pool[current].name, pool[current].id);
+    // Node with two children: take over the inorder successor's data and remove the successor instead
+    if (pool[current].left != nullIndex && pool[current].right != nullIndex) {
+        uint32_t target = current;
+        path.push_back(target);
+        current = pool[target].right;
+        while (pool[current].left != nullIndex) {
+            path.push_back(current);
+            current = pool[current].left;
         }
+        pool[target].id = pool[current].id;  // Replace node's ID with successor's ID
+        pool[target].name = std::move(pool[current].name);  // The successor's slot is released next
     }
-
-    node->updateNodeHeight(node);  // Update height after deletion
-    return rebalance(node);  // Rebalance the tree
+    // current now has at most one child, which takes its place
+    uint32_t replacement = pool[current].left != nullIndex ? pool[current].left : pool[current].right;
+    node = replaceChild(path.size(), current, replacement, node);
+    releaseNode(current);
+    return retraceRemove(node);
+}
+// Walk back up the recorded path after a removal, fixing heights and sizes and rotating where needed
+uint32_t AVL::retraceRemove(uint32_t node) {
+    bool heightSettled = false;
+    for (size_t i = path.size(); i-- > 0;) {
+        uint32_t current = path[i];
+        if (heightSettled) {
+            pool[current].size--;  // Only the size still changes above this point
+            continue;
+        }
+        int oldHeight = pool[current].height;
+        uint32_t subtree = rebalance(current);  // Updates height and size, rotating if unbalanced
+        if (subtree != current) {
+            node = replaceChild(i, current, subtree, node);
+        }
+        // A removal can shrink the subtree even after a rotation, so only an unchanged height ends the walk
+        heightSettled = pool[subtree].height == oldHeight;
+    }
+    return node;
+}
+// Unlink the root of a subtree and return what takes its place
+uint32_t AVL::detachNode(uint32_t node) {
+    // Case 1: Node with no children (leaf)
+    if (pool[node].left == nullIndex && pool[node].right == nullIndex) {
+        releaseNode(node);
+        return nullIndex;
+    }
+    // Case 2: Node with one child (right child)
+    else if (pool[node].left == nullIndex) {
+        uint32_t temp = node;
+        node = pool[node].right;
+        releaseNode(temp);
+    }
+    // Case 2: Node with one child (left child)
+    else if (pool[node].right == nullIndex) {
+        uint32_t temp = node;
+        node = pool[node].left;
+        releaseNode(temp);
+    }
+    // Case 3: Node with two children
+    else {
+        uint32_t temp = smallestNode(pool[node].right);  // Find inorder successor
+        pool[node].id = pool[temp].id;  // Replace node's ID with successor's ID
+        pool[node].name = std::move(pool[temp].name);  // The successor is removed next, so take its name
+        uint32_t child = removeSmallest(pool[node].right);  // Remove the successor's old slot
+        pool[node].right = child;
+    }
+    return node;
+}
+// Remove the node with the smallest ID from a subtree; it has at most a right child
+uint32_t AVL::removeSmallest(uint32_t node) {
+    if (pool[node].left == nullIndex) {
+        return detachNode(node);
+    }
+    uint32_t child = removeSmallest(pool[node].left);
+    pool[node].left = child;
+    updateNodeHeight(node);
+    return rebalance(node);
 }
 // Helper function to remove a node at a given inorder position
 void AVL::removeInorderHelper(int n) {
@@ -272,160 +715,922 @@ void AVL::removeInorderHelper(int n) {
 
     removeInorder(n, flag);
     if (!flag) {
-        cout << "unsuccessful" << endl;
+        out->writeLine("unsuccessful");
     } else {
-        cout << "successful" << endl;
+        out->writeLine("successful");
     }
 }
 // Remove a node based on its inorder position
 void AVL::removeInorder(int n, bool& flag) {
-    vector<Node*> inorderNodes;
-    inorderTraversal(root, inorderNodes);  // Get the nodes in inorder sequence
-
-    if (n < 0 || n >= inorderNodes.size()) {
+    if (n < 0 || n >= nodeSize(root)) {
         flag = false;
         return;
     }
 
-    Node* targetNode = inorderNodes[n];  // Get the nth node
-    root = removeNode(root, targetNode->id, flag);  // Remove the node by its ID
+    root = removeInorderNode(root, n);  // Descend by subtree sizes straight to the nth node
+    flag = true;
+}
+// Remove the node at inorder position n of a subtree
+uint32_t AVL::removeInorderNode(uint32_t node, uint32_t n) {
+    uint32_t leftSize = pool[pool[node].left].size;
+    if (n < leftSize) {
+        uint32_t child = removeInorderNode(pool[node].left, n);  // Target is in the left subtree
+        pool[node].left = child;
+    } else if (n > leftSize) {
+        uint32_t child = removeInorderNode(pool[node].right, n - leftSize - 1);  // Skip the left subtree and this node
+        pool[node].right = child;
+    } else {
+        unindexName(pool[node].name, pool[node].id);
+        node = detachNode(node);  // This node is the nth one
+        if (node == nullIndex) {
+            return node;
+        }
+    }
+
+    updateNodeHeight(node);  // Update height and size after deletion
+    return rebalance(node);
+}
+// Helper function to print nodes with commas, streaming them straight from the traversal
+void AVL::printNodesWithCommas(TreeIterator it, uint64_t limit) {
+    printNames(*out, it, limit);
 }
-// Helper function to print nodes with commas
-void AVL::printNodesWithCommas(const vector<Node*>& nodes) {
-    for (size_t i = 0; i < nodes.size(); i++) {
-        cout << nodes[i]->name;  // Print each node's name
-        if (i != nodes.size() - 1) {
-            cout << ", ";  // Print comma between nodes, but not after the last one
+// Print up to limit names from a traversal, separated by commas, to any sink
+void printNames(OutputSink& out, TreeIterator it, uint64_t limit) {
+    bool first = true;
+    for (; !it.done() && limit > 0; it.next(), limit--) {
+        if (!first) {
+            out.write(", ");  // Print comma between nodes, but not after the last one
         }
+        out.write((*it).name);  // Print each node's name
+        first = false;
     }
-    cout << endl;  // Newline after printing all nodes
+    out.writeLine();  // Newline after printing all nodes
+}
+// Start a lazy traversal of the whole tree
+TreeIterator AVL::traverse(TraversalOrder order) const {
+    return TreeIterator(pool, root, order);
 }
 // Print the nodes in inorder sequence
 void AVL::printInOrderHelper() {
-    vector<Node*> inorderNodes;
-    inorderTraversal(root, inorderNodes);  // Get the inorder sequence
-    printNodesWithCommas(inorderNodes);  // Print nodes
+    printOrder(TraversalOrder::Inorder);
+}
+// Print one page of the inorder sequence: LIMIT names starting at position OFFSET
+void AVL::printInOrderPageHelper(uint64_t offset, uint64_t limit) {
+    TreeIterator it(pool, nullIndex, TraversalOrder::Inorder);
+    it.seekRank(root, offset);  // O(log n) instead of skipping OFFSET nodes one by one
+    printNodesWithCommas(it, limit);
 }
 // Print the nodes in preorder sequence
 void AVL::printPreOrderHelper() {
-    vector<Node*> preorderNodes;
-    preorderTraversal(root, preorderNodes);  // Get the preorder sequence
-    printNodesWithCommas(preorderNodes);  // Print nodes
+    printOrder(TraversalOrder::Preorder);
 }
 // Print the nodes in postorder sequence
 void AVL::printPostOrderHelper() {
-    vector<Node*> postorderNodes;
-    postorderTraversal(root, postorderNodes);  // Get the postorder sequence
-    printNodesWithCommas(postorderNodes);  // Print nodes
+    printOrder(TraversalOrder::Postorder);
+}
+// Print a whole traversal, on several threads when the tree is big enough to be worth it
+void AVL::printOrder(TraversalOrder order) {
+    if (threads > 1 && pool[root].size >= parallelPrintSize) {
+        printParallel(order);
+    } else {
+        printNodesWithCommas(traverse(order));
+    }
+}
+// Run work(i) for every i below count on up to threads threads, each taking the next index as it finishes one
+template <class Work>
+static void forEachParallel(size_t count, unsigned threads, Work work) {
+    atomic<size_t> next(0);
+    auto worker = [&next, count, &work] {
+        for (size_t i = next++; i < count; i = next++) {
+            work(i);
+        }
+    };
+    vector<future<void>> helpers;
+    for (unsigned t = 1; t < threads && t < count; t++) {
+        helpers.push_back(async(launch::async, worker));
+    }
+    worker();
+    for (future<void>& helper : helpers) {
+        helper.get();
+    }
+}
+// Print a traversal byte-for-byte as printNodesWithCommas would, with the formatting spread over threads.
+// The tree is cut into segments in output order; every name is counted as ", " plus the name, so each
+// segment's length is known up front. Prefix sums of the lengths give every segment its place in one
+// shared buffer, the segments are formatted straight into it, and the leading ", " is dropped at the end
+void AVL::printParallel(TraversalOrder order) {
+    int depth = 0;
+    while ((1u << depth) < 8 * std::max(threads, 1u) && depth < 20) {
+        depth++;  // A few subtrees per thread even out their different sizes
+    }
+    vector<PrintSegment> segments;
+    planPrint(root, order, depth, segments);
+
+    vector<uint64_t> lengths(segments.size());
+    forEachParallel(segments.size(), threads, [&](size_t i) {
+        const PrintSegment& segment = segments[i];
+        if (!segment.wholeSubtree) {
+            lengths[i] = 2 + pool[segment.node].name.size();
+            return;
+        }
+        uint64_t length = 0;
+        for (TreeIterator it(pool, segment.node, TraversalOrder::Preorder); !it.done(); it.next()) {
+            length += 2 + (*it).name.size();  // The order doesn't matter for the length
+        }
+        lengths[i] = length;
+    });
+    uint64_t total = 0;
+    for (size_t i = 0; i < segments.size(); i++) {
+        segments[i].offset = total;
+        total += lengths[i];
+    }
+
+    string buffer(total + 1, '\n');  // The last byte stays the line's newline
+    forEachParallel(segments.size(), threads, [&](size_t i) {
+        char* position = &buffer[segments[i].offset];
+        auto place = [&position](const string& name) {
+            *position++ = ',';
+            *position++ = ' ';
+            position = copy(name.begin(), name.end(), position);
+        };
+        if (!segments[i].wholeSubtree) {
+            place(pool[segments[i].node].name);
+            return;
+        }
+        for (TreeIterator it(pool, segments[i].node, order); !it.done(); it.next()) {
+            place((*it).name);
+        }
+    });
+    out->writeRaw(string_view(buffer).substr(total > 0 ? 2 : 0));  // No comma before the first name
+}
+// List the segments of a traversal in output order: whole subtrees at the given depth, single nodes above it
+void AVL::planPrint(uint32_t node, TraversalOrder order, int depth, vector<PrintSegment>& segments) {
+    if (node == nullIndex) {
+        return;
+    }
+    if (depth == 0) {
+        segments.push_back({node, true, 0});
+        return;
+    }
+    if (order == TraversalOrder::Preorder) {
+        segments.push_back({node, false, 0});
+    }
+    planPrint(pool[node].left, order, depth - 1, segments);
+    if (order == TraversalOrder::Inorder) {
+        segments.push_back({node, false, 0});
+    }
+    planPrint(pool[node].right, order, depth - 1, segments);
+    if (order == TraversalOrder::Postorder) {
+        segments.push_back({node, false, 0});
+    }
 }
 // Inorder traversal to collect nodes
-void AVL::inorderTraversal(Node* node, vector<Node*>& nodes) {
-    if (node == nullptr) return;
-    inorderTraversal(node->left, nodes);  // Traverse left subtree
+void AVL::inorderTraversal(uint32_t node, vector<uint32_t>& nodes) {
+    if (node == nullIndex) return;
+    inorderTraversal(pool[node].left, nodes);  // Traverse left subtree
     nodes.push_back(node);  // Visit the current node
-    inorderTraversal(node->right, nodes);  // Traverse right subtree
+    inorderTraversal(pool[node].right, nodes);  // Traverse right subtree
 }
 // Preorder traversal to collect nodes
-void AVL::preorderTraversal(Node* node, vector<Node*>& nodes) {
-    if (node == nullptr) return;
+void AVL::preorderTraversal(uint32_t node, vector<uint32_t>& nodes) {
+    if (node == nullIndex) return;
     nodes.push_back(node);  // Visit the current node
-    preorderTraversal(node->left, nodes);  // Traverse left subtree
-    preorderTraversal(node->right, nodes);  // Traverse right subtree
+    preorderTraversal(pool[node].left, nodes);  // Traverse left subtree
+    preorderTraversal(pool[node].right, nodes);  // Traverse right subtree
 }
 // Postorder traversal to collect nodes
-void AVL::postorderTraversal(Node* node, vector<Node*>& nodes) {
-    if (node == nullptr) return;
-    postorderTraversal(node->left, nodes);  // Traverse left subtree
-    postorderTraversal(node->right, nodes);  // Traverse right subtree
+void AVL::postorderTraversal(uint32_t node, vector<uint32_t>& nodes) {
+    if (node == nullIndex) return;
+    postorderTraversal(pool[node].left, nodes);  // Traverse left subtree
+    postorderTraversal(pool[node].right, nodes);  // Traverse right subtree
     nodes.push_back(node);  // Visit the current node
 }
-// Count the levels in the tree using level-order traversal
-int AVL::printLevelCount(Node* node) {
-    if (node == nullptr) {
-        return 0;  // Empty tree has 0 levels
+// Count the levels in the tree: a subtree's height is exactly its number of levels
+int AVL::printLevelCount(uint32_t node) {
+    return nodeHeight(node);  // Empty trees (the sentinel) have 0 levels
+}
+// Helper function to print the number of levels in the tree
+void AVL::printLCHelper() {
+    out->writeLine(to_string(printLevelCount(root)));  // Print the level count
+}
+// Print the tree's height, its node count, and how many nodes sit at each subtree height,
+// all from counters the tree already maintains
+void AVL::printStatsHelper() {
+    out->writeLine("height " + to_string(nodeHeight(root)));
+    out->writeLine("nodes " + to_string(nodeSize(root)));
+    for (size_t height = 1; height < heightCounts.size(); height++) {
+        out->writeLine("nodes at height " + to_string(height) + ": " + to_string(heightCounts[height]));
     }
-
-    // Queue for level-order traversal
-    std::queue<Node*> q;
-    q.push(node);  // Start with the root
-
-    int levelCount = 0;
-
-    // Traverse each level of the tree
-    while (!q.empty()) {
-        int levelSize = q.size();  // Number of nodes in the current level
-        levelCount++;  // Increment level count
-
-        // Process all nodes in the current level
-        for (int i = 0; i < levelSize; i++) {
-            Node* currentNode = q.front();
-            q.pop();
-
-            // Add left and right children to the queue
-            if (currentNode->left != nullptr) {
-                q.push(currentNode->left);
-            }
-            if (currentNode->right != nullptr) {
-                q.push(currentNode->right);
+}
+// Print every entry with an ID in [low, high] as "ID NAME", one per line, in O(log n + k)
+void AVL::searchRangeHelper(string_view low, string_view high) {
+    uint32_t lowId = 0;
+    uint32_t highId = 0;
+    if (!parseId(low, lowId) || !parseId(high, highId) || lowId > highId) {
+        out->writeLine("unsuccessful");
+        return;
+    }
+    bool flag = false;
+    for (TreeIterator it = lowerBound(lowId); !it.done() && (*it).id <= highId; it.next()) {
+        printEntry(it.node());
+        flag = true;
+    }
+    if (!flag) {
+        out->writeLine("unsuccessful");  // Nothing in the range
+    }
+}
+// Start an inorder traversal at the first node with an ID >= id
+TreeIterator AVL::lowerBound(uint32_t id) const {
+    TreeIterator it(pool, nullIndex, TraversalOrder::Inorder);
+    it.seekLowerBound(root, id);
+    return it;
+}
+// Find the node with the largest ID <= id, or the sentinel if there is none
+uint32_t AVL::floorNode(uint32_t id) const {
+    uint32_t best = nullIndex;
+    uint32_t node = root;
+    while (node != nullIndex) {
+        if (pool[node].id <= id) {
+            best = node;  // A candidate; anything closer is to its right
+            node = pool[node].right;
+        } else {
+            node = pool[node].left;
+        }
+    }
+    return best;
+}
+// Find the node with the smallest ID >= id, or the sentinel if there is none
+uint32_t AVL::ceilingNode(uint32_t id) const {
+    uint32_t best = nullIndex;
+    uint32_t node = root;
+    while (node != nullIndex) {
+        if (pool[node].id >= id) {
+            best = node;  // A candidate; anything closer is to its left
+            node = pool[node].left;
+        } else {
+            node = pool[node].right;
+        }
+    }
+    return best;
+}
+// Helper functions for the nearest-ID commands: each is a single descent that prints "ID NAME"
+void AVL::floorHelper(string_view id) {
+    uint32_t key = 0;
+    printEntry(parseId(id, key) ? floorNode(key) : nullIndex);
+}
+void AVL::ceilingHelper(string_view id) {
+    uint32_t key = 0;
+    printEntry(parseId(id, key) ? ceilingNode(key) : nullIndex);
+}
+// Strict successor: the smallest ID greater than id
+void AVL::nextHelper(string_view id) {
+    uint32_t key = 0;
+    printEntry(parseId(id, key) ? ceilingNode(key + 1) : nullIndex);  // Parsed IDs are at most 99999999, so key + 1 can't wrap
+}
+// Strict predecessor: the largest ID less than id
+void AVL::prevHelper(string_view id) {
+    uint32_t key = 0;
+    printEntry(parseId(id, key) && key > 0 ? floorNode(key - 1) : nullIndex);
+}
+// Inorder position of an ID (0-based, like removeInorder), or -1 if it isn't in the tree
+int AVL::rankOf(uint32_t id) const {
+    int rank = 0;
+    uint32_t node = root;
+    while (node != nullIndex) {
+        const Node& n = pool[node];
+        if (id < n.id) {
+            node = n.left;
+        } else {
+            // Everything in the left subtree comes first, and so does this node when going right
+            rank += pool[n.left].size;
+            if (id == n.id) {
+                return rank;
             }
+            rank++;
+            node = n.right;
         }
     }
-
-    return levelCount;  // Return the total number of levels
+    return -1;
 }
-// Helper function to print the number of levels in the tree
-void AVL::printLCHelper() {
-    cout << printLevelCount(root) << endl;  // Print the level count
+// Node at inorder position n (0-based), or the sentinel if n is out of range
+uint32_t AVL::selectNode(uint32_t n) const {
+    uint32_t node = root;
+    while (node != nullIndex) {
+        uint32_t leftSize = pool[pool[node].left].size;
+        if (n < leftSize) {
+            node = pool[node].left;
+        } else if (n == leftSize) {
+            return node;
+        } else {
+            n -= leftSize + 1;  // Skip the left subtree and this node
+            node = pool[node].right;
+        }
+    }
+    return nullIndex;
 }
-void processCommand(const string& input, AVL& tree) {
-
-    regex commandRegex("(\\w+)(?:\\s+\"([^\"]+)\")?(?:\\s+(\\d+))?");
-    smatch commandMatch;
-
-    if (regex_search(input, commandMatch, commandRegex)) {
-        string command = commandMatch[1];
-        string name = commandMatch[2];
-        string id_or_n = commandMatch[3];
-
-        if (command == "insert" && !name.empty() && !id_or_n.empty()) {
-
-            tree.insertHelper(id_or_n, name);
+// Helper function to print the inorder position of an ID
+void AVL::rankHelper(string_view id) {
+    uint32_t key = 0;
+    int rank = parseId(id, key) ? rankOf(key) : -1;
+    if (rank < 0) {
+        out->writeLine("unsuccessful");
+    } else {
+        out->writeLine(to_string(rank));
+    }
+}
+// Helper function to print the entry at an inorder position without removing it
+void AVL::selectHelper(int n) {
+    printEntry(n < 0 ? nullIndex : selectNode(n));
+}
+// Print a node as "ID NAME", or unsuccessful for the sentinel
+void AVL::printEntry(uint32_t node) {
+    if (node == nullIndex) {
+        out->writeLine("unsuccessful");
+        return;
+    }
+    out->write(formatId(pool[node].id));
+    out->write(" ");
+    out->writeLine(pool[node].name);
+}
+// Helper function to bulk-load a file of "NAME" ID lines; nothing is loaded unless every line is valid
+void AVL::loadHelper(string_view path) {
+    ifstream file{string(path)};
+    if (!file) {
+        out->writeLine("unsuccessful");
+        return;
+    }
+    vector<pair<uint32_t, string>> records;
+    string line;
+    while (getline(file, line)) {
+        size_t pos = line.find_first_not_of(" \t\r");
+        if (pos == string::npos) {
+            continue;  // Skip blank lines
         }
-        else if (command == "remove" && !id_or_n.empty()) {
-
-            tree.removeHelper(id_or_n);
+        // Quoted name
+        size_t nameEnd = line[pos] == '"' ? line.find('"', pos + 1) : string::npos;
+        if (nameEnd == string::npos || nameEnd == pos + 1) {
+            out->writeLine("unsuccessful");
+            return;
         }
-        else if (command == "search" && !id_or_n.empty()) {
-
-            tree.searchIdHelper(id_or_n);
+        string name = line.substr(pos + 1, nameEnd - pos - 1);
+        // 8-digit ID, optionally followed by whitespace
+        size_t idStart = line.find_first_not_of(" \t", nameEnd + 1);
+        size_t idEnd = idStart == string::npos ? string::npos : line.find_first_of(" \t\r", idStart);
+        uint32_t id = 0;
+        bool valid = idStart != string::npos && idStart > nameEnd + 1
+            && parseId(line.substr(idStart, idEnd == string::npos ? string::npos : idEnd - idStart), id)
+            && (idEnd == string::npos || line.find_first_not_of(" \t\r", idEnd) == string::npos);
+        valid = valid && validName(name);  // Same name rule as insert
+        if (!valid) {
+            out->writeLine("unsuccessful");
+            return;
         }
-        else if (command == "search" && !name.empty()) {
-
-            tree.searchNameHelper(name);
+        records.emplace_back(id, std::move(name));
+    }
+    if (bulkLoad(std::move(records))) {
+        out->writeLine("successful");
+    } else {
+        out->writeLine("unsuccessful");  // Duplicate IDs
+    }
+}
+// Add a batch of (ID, name) records at once and rebuild a perfectly balanced tree in linear time.
+// The batch is sorted first if it isn't already; any duplicate ID rejects the whole batch
+bool AVL::bulkLoad(vector<pair<uint32_t, string>> records) {
+    auto byId = [](const pair<uint32_t, string>& a, const pair<uint32_t, string>& b) { return a.first < b.first; };
+    if (!is_sorted(records.begin(), records.end(), byId)) {
+        sort(records.begin(), records.end(), byId);
+    }
+    for (size_t i = 1; i < records.size(); i++) {
+        if (records[i].first == records[i - 1].first) {
+            return false;  // Duplicate inside the batch
+        }
+    }
+    vector<uint32_t> existing;
+    inorderTraversal(root, existing);  // Nodes already in the tree, in ID order
+    size_t e = 0;
+    for (const auto& record : records) {
+        while (e < existing.size() && pool[existing[e]].id < record.first) {
+            e++;
         }
-        else if (command == "printInorder") {
+        if (e < existing.size() && pool[existing[e]].id == record.first) {
+            return false;  // Already in the tree
+        }
+    }
 
-            tree.printInOrderHelper();
+    // Merge the existing nodes with freshly allocated ones into one sorted sequence
+    vector<uint32_t> merged;
+    merged.reserve(existing.size() + records.size());
+    e = 0;
+    for (auto& record : records) {
+        while (e < existing.size() && pool[existing[e]].id < record.first) {
+            merged.push_back(existing[e++]);
         }
-        else if (command == "printPreorder") {
+        indexName(record.second, record.first);
+        merged.push_back(createNode(std::move(record.second), record.first));
+    }
+    merged.insert(merged.end(), existing.begin() + e, existing.end());
 
-            tree.printPreOrderHelper();
+    root = buildBalanced(merged, 0, merged.size());
+    return true;
+}
+// Link a sorted run of nodes into a balanced subtree by always rooting it at the middle node
+uint32_t AVL::buildBalanced(const vector<uint32_t>& nodes, size_t begin, size_t end) {
+    fingerValid = false;  // Relinks nodes the last insert's path may run through
+    if (begin == end) {
+        return nullIndex;
+    }
+    size_t middle = begin + (end - begin) / 2;
+    uint32_t node = nodes[middle];
+    uint32_t left = buildBalanced(nodes, begin, middle);
+    uint32_t right = buildBalanced(nodes, middle + 1, end);
+    pool[node].left = left;
+    pool[node].right = right;
+    updateNodeHeight(node);  // Children are done, so height and size come out right
+    return node;
+}
+// Fold a finished subtask's bookkeeping into this one
+void SetTask::absorb(SetTask& other) {
+    discarded.insert(discarded.end(), other.discarded.begin(), other.discarded.end());
+    if (heightChanges.size() < other.heightChanges.size()) {
+        heightChanges.resize(other.heightChanges.size());
+    }
+    for (size_t h = 0; h < other.heightChanges.size(); h++) {
+        heightChanges[h] += other.heightChanges[h];
+    }
+}
+// Run the two independent halves of a set operation. When forking, the second half runs on another
+// thread with a task of its own; the halves touch disjoint nodes and never allocate, so no locking is needed
+template <class First, class Second>
+static void forkJoin(bool fork, First first, Second second) {
+    if (!fork) {
+        first();
+        second();
+        return;
+    }
+    SetTask secondTask;
+    future<void> pending = async(launch::async, [&secondTask, &second] {
+        currentTask = &secondTask;
+        second();
+        currentTask = nullptr;
+    });
+    first();
+    pending.get();
+    currentTask->absorb(secondTask);
+}
+// Join two trees and a middle node, where every ID on the left is below the middle and every ID on the right above it
+uint32_t AVL::join(uint32_t left, uint32_t middle, uint32_t right) {
+    if (nodeHeight(left) > nodeHeight(right) + 1) {
+        return joinRight(left, middle, right);  // Hang the right tree off the left tree's right spine
+    }
+    if (nodeHeight(right) > nodeHeight(left) + 1) {
+        return joinLeft(left, middle, right);  // Hang the left tree off the right tree's left spine
+    }
+    // Heights are within one of each other, so the middle node can simply take both as children
+    pool[middle].left = left;
+    pool[middle].right = right;
+    updateNodeHeight(middle);
+    return middle;
+}
+// Join when the left tree is taller: walk down its right spine to a subtree about as tall as the right tree
+uint32_t AVL::joinRight(uint32_t left, uint32_t middle, uint32_t right) {
+    uint32_t spine = pool[left].right;
+    if (nodeHeight(spine) <= nodeHeight(right) + 1) {
+        pool[middle].left = spine;
+        pool[middle].right = right;
+        updateNodeHeight(middle);
+        pool[left].right = middle;
+        if (nodeHeight(middle) > nodeHeight(pool[left].left) + 1) {
+            return rotateRightLeft(left);  // The middle node's subtree is now too tall
+        }
+        updateNodeHeight(left);
+        return left;
+    }
+    pool[left].right = joinRight(spine, middle, right);
+    updateNodeHeight(left);
+    if (nodeHeight(pool[left].right) > nodeHeight(pool[left].left) + 1) {
+        return rotateLeft(left);
+    }
+    return left;
+}
+// Join when the right tree is taller, mirroring joinRight
+uint32_t AVL::joinLeft(uint32_t left, uint32_t middle, uint32_t right) {
+    uint32_t spine = pool[right].left;
+    if (nodeHeight(spine) <= nodeHeight(left) + 1) {
+        pool[middle].left = left;
+        pool[middle].right = spine;
+        updateNodeHeight(middle);
+        pool[right].left = middle;
+        if (nodeHeight(middle) > nodeHeight(pool[right].right) + 1) {
+            return rotateLeftRight(right);
+        }
+        updateNodeHeight(right);
+        return right;
+    }
+    pool[right].left = joinLeft(left, middle, spine);
+    updateNodeHeight(right);
+    if (nodeHeight(pool[right].left) > nodeHeight(pool[right].right) + 1) {
+        return rotateRight(right);
+    }
+    return right;
+}
+// Join two trees without a middle node by borrowing the largest node of the left tree
+uint32_t AVL::joinPair(uint32_t left, uint32_t right) {
+    if (left == nullIndex) {
+        return right;
+    }
+    uint32_t rest = nullIndex;
+    uint32_t last = nullIndex;
+    splitLast(left, rest, last);
+    return join(rest, last, right);
+}
+// Split a tree into the nodes below an ID, the node holding it (or the sentinel), and the nodes above it.
+// The found node keeps stale links; it is either joined back in or released
+void AVL::split(uint32_t node, uint32_t id, uint32_t& left, uint32_t& found, uint32_t& right) {
+    if (node == nullIndex) {
+        left = found = right = nullIndex;
+        return;
+    }
+    if (id == pool[node].id) {
+        left = pool[node].left;
+        found = node;
+        right = pool[node].right;
+    } else if (id < pool[node].id) {
+        uint32_t above = nullIndex;
+        split(pool[node].left, id, left, found, above);
+        right = join(above, node, pool[node].right);  // This node and its right subtree are all above the ID
+    } else {
+        uint32_t below = nullIndex;
+        split(pool[node].right, id, below, found, right);
+        left = join(pool[node].left, node, below);
+    }
+}
+// Split off the node with the largest ID, leaving the rest of the tree balanced
+void AVL::splitLast(uint32_t node, uint32_t& rest, uint32_t& last) {
+    if (pool[node].right == nullIndex) {
+        rest = pool[node].left;
+        last = node;
+        return;
+    }
+    uint32_t tail = nullIndex;
+    splitLast(pool[node].right, tail, last);
+    rest = join(pool[node].left, node, tail);
+}
+// How many levels of a set operation may fork; a few more tasks than threads evens out uneven halves
+int AVL::setOperationForks() const {
+    int forks = 0;
+    while (threads > 1 && (1u << forks) < 2 * threads && forks < 16) {
+        forks++;
+    }
+    return forks;
+}
+// Add every entry of another tree to this one. Where both trees hold an ID, this tree's entry is kept
+void AVL::unionWith(const AVL& other) {
+    if (&other == this) {
+        return;
+    }
+    vector<uint32_t> copies;
+    uint32_t copy = copySubtree(other.pool, other.root, copies);  // Allocate up front so the tasks never have to
+    SetTask task;
+    currentTask = &task;
+    root = unionNodes(root, copy, setOperationForks());
+    currentTask = nullptr;
+    finishSetOperation(task, copies);
+}
+// Keep only the entries whose ID is also in another tree
+void AVL::intersectWith(const AVL& other) {
+    if (&other == this) {
+        return;
+    }
+    vector<uint32_t> copies;
+    SetTask task;
+    currentTask = &task;
+    root = intersectNodes(root, other.pool, other.root, setOperationForks());  // Only reads the other tree
+    currentTask = nullptr;
+    finishSetOperation(task, copies);
+}
+// Drop the entries whose ID is in another tree
+void AVL::differenceWith(const AVL& other) {
+    if (&other == this) {
+        AVL snapshot(other);  // The other tree must not change while it is being read
+        differenceWith(snapshot);
+        return;
+    }
+    vector<uint32_t> copies;
+    SetTask task;
+    currentTask = &task;
+    root = differenceNodes(root, other.pool, other.root, setOperationForks());
+    currentTask = nullptr;
+    finishSetOperation(task, copies);
+}
+// Union of two trees in this pool: split this one around the other's root, then recurse on both sides
+uint32_t AVL::unionNodes(uint32_t node, uint32_t other, int forks) {
+    if (node == nullIndex) {
+        return other;
+    }
+    if (other == nullIndex) {
+        return node;
+    }
+    uint32_t otherLeft = pool[other].left;
+    uint32_t otherRight = pool[other].right;
+    uint32_t left = nullIndex;
+    uint32_t found = nullIndex;
+    uint32_t right = nullIndex;
+    // The work is bounded by the smaller tree; a few nodes merged into a big tree aren't worth a thread
+    uint32_t size = std::min(pool[node].size, pool[other].size);
+    split(node, pool[other].id, left, found, right);
+    bool fork = forks > 0 && size >= parallelGrain;
+    forkJoin(fork, [&] { left = unionNodes(left, otherLeft, forks - 1); },
+             [&] { right = unionNodes(right, otherRight, forks - 1); });
+    if (found != nullIndex) {
+        currentTask->discarded.push_back(other);  // Duplicate ID: this tree's node wins
+        return join(left, found, right);
+    }
+    return join(left, other, right);
+}
+// Intersection with a tree in another pool, which is only read
+uint32_t AVL::intersectNodes(uint32_t node, const NodePool& otherPool, uint32_t other, int forks) {
+    if (node == nullIndex) {
+        return nullIndex;
+    }
+    if (other == nullIndex) {
+        for (TreeIterator it(pool, node, TraversalOrder::Preorder); !it.done(); it.next()) {
+            currentTask->discarded.push_back(it.node());  // Nothing left to match against
+        }
+        return nullIndex;
+    }
+    uint32_t left = nullIndex;
+    uint32_t found = nullIndex;
+    uint32_t right = nullIndex;
+    uint32_t size = std::min(pool[node].size, otherPool[other].size);  // As in unionNodes
+    split(node, otherPool[other].id, left, found, right);
+    bool fork = forks > 0 && size >= parallelGrain;
+    forkJoin(fork, [&] { left = intersectNodes(left, otherPool, otherPool[other].left, forks - 1); },
+             [&] { right = intersectNodes(right, otherPool, otherPool[other].right, forks - 1); });
+    if (found != nullIndex) {
+        return join(left, found, right);
+    }
+    return joinPair(left, right);
+}
+// Difference with a tree in another pool, which is only read
+uint32_t AVL::differenceNodes(uint32_t node, const NodePool& otherPool, uint32_t other, int forks) {
+    if (node == nullIndex || other == nullIndex) {
+        return node;
+    }
+    uint32_t left = nullIndex;
+    uint32_t found = nullIndex;
+    uint32_t right = nullIndex;
+    uint32_t size = std::min(pool[node].size, otherPool[other].size);  // As in unionNodes
+    split(node, otherPool[other].id, left, found, right);
+    bool fork = forks > 0 && size >= parallelGrain;
+    forkJoin(fork, [&] { left = differenceNodes(left, otherPool, otherPool[other].left, forks - 1); },
+             [&] { right = differenceNodes(right, otherPool, otherPool[other].right, forks - 1); });
+    if (found != nullIndex) {
+        currentTask->discarded.push_back(found);
+    }
+    return joinPair(left, right);
+}
+// Copy a subtree from another pool into this one, shape and all; the copies are not indexed by name yet
+uint32_t AVL::copySubtree(const NodePool& from, uint32_t node, vector<uint32_t>& copies) {
+    if (node == nullIndex) {
+        return nullIndex;
+    }
+    uint32_t left = copySubtree(from, from[node].left, copies);
+    uint32_t right = copySubtree(from, from[node].right, copies);
+    uint32_t copy = createNode(from[node].name, from[node].id);
+    pool[copy].left = left;
+    pool[copy].right = right;
+    updateNodeHeight(copy);
+    copies.push_back(copy);
+    return copy;
+}
+// Back on one thread: apply the histogram changes, release the dropped nodes and index the names that came in
+void AVL::finishSetOperation(SetTask& task, vector<uint32_t>& copies) {
+    fingerValid = false;  // The splits and joins reshaped the tree
+    for (size_t h = 0; h < task.heightChanges.size(); h++) {
+        if (task.heightChanges[h] != 0) {
+            countHeight(static_cast<int>(h), static_cast<int>(task.heightChanges[h]));
+        }
+    }
+    sort(copies.begin(), copies.end());
+    sort(task.discarded.begin(), task.discarded.end());
+    for (uint32_t node : task.discarded) {
+        if (!binary_search(copies.begin(), copies.end(), node)) {
+            unindexName(pool[node].name, pool[node].id);  // Copies were never indexed
+        }
+        releaseNode(node);
+    }
+    for (uint32_t node : copies) {
+        if (!binary_search(task.discarded.begin(), task.discarded.end(), node)) {
+            indexName(pool[node].name, pool[node].id);
         }
-        else if (command == "printPostorder") {
+    }
+}
+// Character classes of the command grammar (matching \w, \s and \d in the C locale)
+static bool isWordChar(char c) {
+    return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+static bool isSpaceChar(char c) {
+    return isspace(static_cast<unsigned char>(c)) != 0;
+}
+static bool isDigitChar(char c) {
+    return c >= '0' && c <= '9';
+}
+// Lex an optional number at pos: at least one space, then a run of digits. Returns where lexing stopped
+static size_t lexNumber(string_view line, size_t pos, string_view& number, uint64_t& value) {
+    size_t scan = pos;
+    size_t length = line.size();
+    while (scan < length && isSpaceChar(line[scan])) {
+        scan++;
+    }
+    if (scan == pos || scan == length || !isDigitChar(line[scan])) {
+        return pos;  // No number here
+    }
+    size_t numberStart = scan;
+    while (scan < length && isDigitChar(line[scan])) {
+        // Stop accumulating past 32 bits; anything this large is rejected later anyway
+        value = value > UINT32_MAX ? value : value * 10 + (line[scan] - '0');
+        scan++;
+    }
+    number = line.substr(numberStart, scan - numberStart);
+    return scan;
+}
+// Lex a command line in one pass without allocating. The grammar is
+//     WORD [ SPACES "NAME" ] [ SPACES DIGITS [ SPACES DIGITS ] ]
+// searched for anywhere in the line. Up to the first number this is exactly
+// regex_search with (\w+)(?:\s+"([^"]+)")?(?:\s+(\d+))?; the second number is for range commands
+bool lexCommand(string_view line, Command& command) {
+    command = Command{Opcode::None, {}, {}, {}, 0, {}, 0};
+    size_t pos = 0;
+    size_t length = line.size();
+    // The command word starts at the first word character anywhere in the line
+    while (pos < length && !isWordChar(line[pos])) {
+        pos++;
+    }
+    if (pos == length) {
+        return false;  // No command word at all
+    }
+    size_t wordStart = pos;
+    while (pos < length && isWordChar(line[pos])) {
+        pos++;
+    }
+    command.word = line.substr(wordStart, pos - wordStart);
 
-            tree.printPostOrderHelper();
+    // Optional quoted name: at least one space, then a non-empty run of non-quote characters in quotes
+    size_t scan = pos;
+    while (scan < length && isSpaceChar(line[scan])) {
+        scan++;
+    }
+    if (scan > pos && scan < length && line[scan] == '"') {
+        size_t nameStart = scan + 1;
+        size_t nameEnd = nameStart;
+        while (nameEnd < length && line[nameEnd] != '"') {
+            nameEnd++;
         }
-        else if (command == "printLevelCount") {
+        if (nameEnd > nameStart && nameEnd < length) {
+            command.name = line.substr(nameStart, nameEnd - nameStart);
+            pos = nameEnd + 1;  // Continue after the closing quote
+        }
+    }
+
+    // Optional numbers
+    pos = lexNumber(line, pos, command.number, command.value);
+    if (!command.number.empty()) {
+        lexNumber(line, pos, command.secondNumber, command.secondValue);
+    }
+
+    // Resolve the opcode the same way the dispatch always has
+    string_view word = command.word;
+    bool hasName = !command.name.empty();
+    bool hasNumber = !command.number.empty();
+    if (word == "insert" && hasName && hasNumber) {
+        command.opcode = Opcode::Insert;
+    } else if (word == "remove" && hasNumber) {
+        command.opcode = Opcode::Remove;
+    } else if (word == "search" && hasNumber) {
+        command.opcode = Opcode::SearchId;
+    } else if (word == "search" && hasName) {
+        command.opcode = Opcode::SearchName;
+    } else if (word == "printInorder" && !command.secondNumber.empty()) {
+        command.opcode = Opcode::PrintInorderPage;
+    } else if (word == "printInorder") {
+        command.opcode = Opcode::PrintInorder;
+    } else if (word == "printPreorder") {
+        command.opcode = Opcode::PrintPreorder;
+    } else if (word == "printPostorder") {
+        command.opcode = Opcode::PrintPostorder;
+    } else if (word == "printLevelCount") {
+        command.opcode = Opcode::PrintLevelCount;
+    } else if (word == "removeInorder" && hasNumber) {
+        command.opcode = Opcode::RemoveInorder;
+    } else if (word == "load" && hasName) {
+        command.opcode = Opcode::Load;
+    } else if (word == "stats") {
+        command.opcode = Opcode::Stats;
+    } else if (word == "searchRange" && hasNumber && !command.secondNumber.empty()) {
+        command.opcode = Opcode::SearchRange;
+    } else if (word == "floor" && hasNumber) {
+        command.opcode = Opcode::Floor;
+    } else if (word == "ceiling" && hasNumber) {
+        command.opcode = Opcode::Ceiling;
+    } else if (word == "next" && hasNumber) {
+        command.opcode = Opcode::Next;
+    } else if (word == "prev" && hasNumber) {
+        command.opcode = Opcode::Prev;
+    } else if (word == "rank" && hasNumber) {
+        command.opcode = Opcode::Rank;
+    } else if (word == "select" && hasNumber) {
+        command.opcode = Opcode::Select;
+    }
+    return true;
+}
+void processCommand(string_view input, AVL& tree) {
+    Command command;
+
+    if (!lexCommand(input, command)) {
+        tree.out->writeLine("unsuccessful");
+        return;
+    }
 
+    switch (command.opcode) {
+        case Opcode::Insert:
+            tree.insertHelper(command.number, command.name);
+            break;
+        case Opcode::Remove:
+            tree.removeHelper(command.number);
+            break;
+        case Opcode::SearchId:
+            tree.searchIdHelper(command.number);
+            break;
+        case Opcode::SearchName:
+            tree.searchNameHelper(command.name);
+            break;
+        case Opcode::PrintInorder:
+            tree.printInOrderHelper();
+            break;
+        case Opcode::PrintPreorder:
+            tree.printPreOrderHelper();
+            break;
+        case Opcode::PrintPostorder:
+            tree.printPostOrderHelper();
+            break;
+        case Opcode::PrintLevelCount:
             tree.printLCHelper();
+            break;
+        case Opcode::RemoveInorder:
+            // Positions past INT_MAX can never exist, so clamping keeps them unsuccessful
+            tree.removeInorderHelper(static_cast<int>(min<uint64_t>(command.value, INT32_MAX)));
+            break;
+        case Opcode::Load:
+            tree.loadHelper(command.name);
+            break;
+        case Opcode::Stats:
+            tree.printStatsHelper();
+            break;
+        case Opcode::SearchRange:
+            tree.searchRangeHelper(command.number, command.secondNumber);
+            break;
+        case Opcode::Floor:
+            tree.floorHelper(command.number);
+            break;
+        case Opcode::Ceiling:
+            tree.ceilingHelper(command.number);
+            break;
+        case Opcode::Next:
+            tree.nextHelper(command.number);
+            break;
+        case Opcode::Prev:
+            tree.prevHelper(command.number);
+            break;
+        case Opcode::Rank:
+            tree.rankHelper(command.number);
+            break;
+        case Opcode::Select:
+            tree.selectHelper(static_cast<int>(min<uint64_t>(command.value, INT32_MAX)));
+            break;
+        case Opcode::PrintInorderPage:
+            tree.printInOrderPageHelper(command.value, command.secondValue);
+            break;
+        case Opcode::None:
+            break;
+    }
+}
+// Run a sequence of command lines. Runs of consecutive inserts are merged into the tree as one batch;
+// the per-command results are the same as running processCommand on each line, but the tree's shape may not be
+void processCommands(const vector<string>& lines, size_t count, AVL& tree) {
+    vector<pair<string_view, string_view>> inserts;
+    Command command;
+    for (size_t i = 0; i < count; i++) {
+        if (lexCommand(lines[i], command) && command.opcode == Opcode::Insert) {
+            inserts.emplace_back(command.number, command.name);
+            continue;
         }
-        else if (command == "removeInorder" && !id_or_n.empty()) {
-
-            int n = stoi(id_or_n);
-            tree.removeInorderHelper(n);
+        if (!inserts.empty()) {
+            tree.insertBatchHelper(inserts);
+            inserts.clear();
         }
-
-    } else {
-        cout << "unsuccessful" << endl;
+        processCommand(lines[i], tree);
+    }
+    if (!inserts.empty()) {
+        tree.insertBatchHelper(inserts);
     }
 }
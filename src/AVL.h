@@ -1,59 +1,260 @@
 #ifndef AVL_H  // Include guard
 #define AVL_H
 #include <vector>
-#include <queue>
 #include <string>
+#include <string_view>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <ostream>
 using namespace std;
 
+// Nodes are addressed by 32-bit indices into the pool; slot 0 is a sentinel that stands in for nullptr
+const uint32_t nullIndex = 0;
+
 class Node {
 public:
     string name;
-    string id;
+    uint32_t id;  // 8-digit ID packed into one word, printed back zero-padded
     int height;
-    Node* left;
-    Node* right;
+    uint32_t size;   // Number of nodes in this subtree, for order-statistic descents
+    uint32_t left;   // Index of the left child in the pool
+    uint32_t right;  // Index of the right child in the pool
+
+    Node();
+    Node(string name, uint32_t id);
+};
+
+// Node storage: nodes live in fixed-size chunks and links are 32-bit indices (chunk number, then
+// slot in the chunk), so the tree can be copied or moved wholesale and growing the pool never moves
+// a node that is already there. Removed slots are recycled through a free list
+class NodePool {
+public:
+    static const uint32_t chunkShift = 12;
+    static const uint32_t chunkSize = 1u << chunkShift;  // Nodes per chunk
+    size_t chunksAllocated;  // Chunks added as the pool grew
+    size_t nodesAllocated;   // Total allocate() calls
+    size_t nodesReused;      // allocate() calls served from the free list
+    size_t liveNodes;        // Nodes currently handed out
+
+    uint32_t allocate(string name, uint32_t id);
+    void release(uint32_t index);
+    Node& operator[](uint32_t index) { return chunks[index >> chunkShift][index & (chunkSize - 1)]; }
+    const Node& operator[](uint32_t index) const { return chunks[index >> chunkShift][index & (chunkSize - 1)]; }
+
+    NodePool();
 
-    Node(string name, string id);
-    int nodeHeight(Node* node);
-    int updateNodeHeight(Node* node);
-    int getBalanceFactor(Node* node);
+private:
+    vector<vector<Node>> chunks;  // Each holds at most chunkSize nodes; chunks[0][0] is the sentinel
+    uint32_t freeList;   // Head of the released slots, chained through Node::left
+};
+
+enum class TraversalOrder {
+    Inorder,
+    Preorder,
+    Postorder
+};
+
+// Lazy depth-first traversal over a tree in the pool. Only the current root-to-node path is kept
+// on an explicit stack, so walking the whole tree needs O(height) memory instead of O(n)
+class TreeIterator {
+public:
+    TreeIterator(const NodePool& pool, uint32_t root, TraversalOrder order);
+    void seekLowerBound(uint32_t root, uint32_t id);  // Inorder only: jump to the first node with an ID >= id
+    void seekRank(uint32_t root, uint64_t n);         // Inorder only: jump to the node at position n
+    bool done() const { return stack.empty(); }
+    uint32_t node() const { return stack.back(); }  // Current node; only valid while !done()
+    const Node& operator*() const { return (*pool)[stack.back()]; }
+    void next();
+
+private:
+    const NodePool* pool;
+    TraversalOrder order;
+    vector<uint32_t> stack;
+    void pushLeftSpine(uint32_t node);     // Inorder: the next node is the leftmost one below
+    void pushFirstPostorder(uint32_t node);  // Postorder: the next node is the first leaf reached going left when possible
+};
+
+// Buffered writer for command output. Text is collected in memory and handed to the
+// target stream only when the buffer fills up, on flush(), or per line when lineBuffered is set
+class OutputSink {
+public:
+    static const size_t defaultCapacity = 1 << 20;
+    bool lineBuffered;  // Flush after every line, for interactive sessions
+
+    explicit OutputSink(ostream& target, size_t capacity = defaultCapacity);
+    OutputSink(const OutputSink&) = delete;  // Two sinks holding the same pending text would print it twice
+    OutputSink& operator=(const OutputSink&) = delete;
+    ~OutputSink();
+    void write(string_view text);
+    void writeLine(string_view text = {});
+    void writeRaw(string_view text);  // Bypasses the buffer, for output too big to be worth copying
+    void flush();
+
+private:
+    ostream* target;
+    string buffer;
+    size_t capacity;
+};
+
+OutputSink& standardOutput();  // Process-wide sink in front of cout
+
+// Part of a parallel print: a single node, or a whole subtree printed in the traversal's order
+struct PrintSegment {
+    uint32_t node;
+    bool wholeSubtree;
+    uint64_t offset;  // Where the segment's text starts in the output buffer
+};
+
+// What one task of a set operation keeps to itself while it runs, merged into its parent's when it is done
+struct SetTask {
+    vector<uint32_t> discarded;     // Nodes that drop out of the result, released at the end
+    vector<int64_t> heightChanges;  // Height histogram changes, applied at the end
+    void absorb(SetTask& other);
 };
 
 class AVL {
 public:
-    Node* root;
-    Node* insert(Node* node, string name, string id, bool& flag);  // Changed id type to string
-    Node* rotateLeft(Node* node);
-    Node* rotateRight(Node* node);
-    Node* rotateLeftRight(Node* node);
-    Node* rotateRightLeft(Node* node);
-    Node* rebalance(Node* node);   // Changed id type to string
-    Node* removeNode(Node* node, string id, bool&flag);
-    Node* smallestNode(Node* node);
-    void insertHelper(string id, string name);
-    void removeHelper(string id);
-    void searchIdHelper(string id);
-    void searchId(Node* node, string id, bool& flag);
-    void searchNameHelper(string name);
-    void searchName(Node* node, string name, bool& flag);
+    uint32_t root;
+    OutputSink* out;  // Where command results are written; shared, not owned
+    NodePool pool;  // Owns the storage of every node in the tree
+    map<string, set<uint32_t>, less<>> nameIndex;  // Name -> IDs of the nodes with that name, in order; looked up by string_view
+    vector<uint32_t> heightCounts;  // heightCounts[h] = number of nodes whose subtree has height h
+    int nodeHeight(uint32_t node);
+    int nodeSize(uint32_t node);
+    int updateNodeHeight(uint32_t node);
+    int getBalanceFactor(uint32_t node);
+    uint32_t createNode(string name, uint32_t id);
+    void releaseNode(uint32_t node);
+    void countHeight(int height, int delta);
+    vector<uint32_t> path;  // Nodes visited by the current insert or removal, root first
+    // After an insert, path is a finger: the root-to-node path of the insert (as far as rotations left it intact)
+    // with each subtree's exclusive ID bounds, so the next insert can start from the deepest subtree that holds its ID.
+    // That makes the search O(1) for increasing IDs, but the insert is still O(log n): retraceInsert bumps the size
+    // of every ancestor. Anything else that reshapes the tree clears fingerValid
+    vector<pair<int64_t, int64_t>> pathBounds;
+    bool fingerValid;
+    uint32_t insert(uint32_t node, string_view name, uint32_t id, bool& flag);
+    uint32_t retraceInsert(uint32_t node);
+    uint32_t retraceRemove(uint32_t node);
+    uint32_t replaceChild(size_t i, uint32_t oldChild, uint32_t newChild, uint32_t subtreeRoot);
+    uint32_t rotateLeft(uint32_t node);
+    uint32_t rotateRight(uint32_t node);
+    uint32_t rotateLeftRight(uint32_t node);
+    uint32_t rotateRightLeft(uint32_t node);
+    uint32_t rebalance(uint32_t node);
+    uint32_t removeNode(uint32_t node, uint32_t id, bool&flag);
+    uint32_t detachNode(uint32_t node);
+    uint32_t removeSmallest(uint32_t node);
+    uint32_t smallestNode(uint32_t node);
+    uint32_t findNode(uint32_t id) const;
+    void indexName(string_view name, uint32_t id);
+    void unindexName(string_view name, uint32_t id);
+    void insertHelper(string_view id, string_view name);
+    void insertBatchHelper(const vector<pair<string_view, string_view>>& batch);
+    static bool validName(string_view name);
+    void removeHelper(string_view id);
+    void searchIdHelper(string_view id);
+    void searchId(uint32_t node, uint32_t id, bool& flag);
+    void searchNameHelper(string_view name);
+    void searchName(string_view name, bool& flag);
+    vector<uint32_t> idsNamed(string_view name) const;
     void removeInorderHelper(int n) ;
     void removeInorder(int n, bool&flag);
-    void inorderTraversal(Node* node, vector<Node*>& nodes);
-    void postorderTraversal(Node* node, vector<Node*>& nodes);
-    void preorderTraversal(Node* node, vector<Node*>& nodes);
+    uint32_t removeInorderNode(uint32_t node, uint32_t n);
+    void inorderTraversal(uint32_t node, vector<uint32_t>& nodes);
+    void postorderTraversal(uint32_t node, vector<uint32_t>& nodes);
+    void preorderTraversal(uint32_t node, vector<uint32_t>& nodes);
     void printInOrderHelper();
     void printPreOrderHelper();
     void printPostOrderHelper();
-    void printInOrder(Node* node);
-    void printPreOrder(Node* node);
-    void printPostOrder(Node* node);
-    int printLevelCount(Node* node);
+    static const uint32_t parallelPrintSize = 1 << 16;  // Smaller trees are always printed on one thread
+    void printOrder(TraversalOrder order);
+    void printParallel(TraversalOrder order);
+    void planPrint(uint32_t node, TraversalOrder order, int depth, vector<PrintSegment>& segments);
+    int printLevelCount(uint32_t node);
     void printLCHelper();
-    void printNodesWithCommas(const vector<Node*>& nodes);
+    void printStatsHelper();
+    void searchRangeHelper(string_view low, string_view high);
+    TreeIterator lowerBound(uint32_t id) const;
+    uint32_t floorNode(uint32_t id) const;
+    uint32_t ceilingNode(uint32_t id) const;
+    void floorHelper(string_view id);
+    void ceilingHelper(string_view id);
+    void nextHelper(string_view id);
+    void prevHelper(string_view id);
+    void printEntry(uint32_t node);
+    int rankOf(uint32_t id) const;
+    uint32_t selectNode(uint32_t n) const;
+    void rankHelper(string_view id);
+    void selectHelper(int n);
+    void printNodesWithCommas(TreeIterator it, uint64_t limit = UINT64_MAX);
+    void printInOrderPageHelper(uint64_t offset, uint64_t limit);
+    TreeIterator traverse(TraversalOrder order) const;
+    void loadHelper(string_view path);
+    bool bulkLoad(vector<pair<uint32_t, string>> records);
+    uint32_t buildBalanced(const vector<uint32_t>& nodes, size_t begin, size_t end);
+    static const uint32_t parallelGrain = 4096;  // Set operations never fork while the smaller operand has fewer nodes than this
+    unsigned threads;  // Threads the set operations and large prints may use; 1 keeps them on the calling thread
+    uint32_t join(uint32_t left, uint32_t middle, uint32_t right);
+    uint32_t joinLeft(uint32_t left, uint32_t middle, uint32_t right);
+    uint32_t joinRight(uint32_t left, uint32_t middle, uint32_t right);
+    uint32_t joinPair(uint32_t left, uint32_t right);
+    void split(uint32_t node, uint32_t id, uint32_t& left, uint32_t& found, uint32_t& right);
+    void splitLast(uint32_t node, uint32_t& rest, uint32_t& last);
+    void unionWith(const AVL& other);
+    void intersectWith(const AVL& other);
+    void differenceWith(const AVL& other);
+    uint32_t unionNodes(uint32_t node, uint32_t other, int forks);
+    uint32_t intersectNodes(uint32_t node, const NodePool& otherPool, uint32_t other, int forks);
+    uint32_t differenceNodes(uint32_t node, const NodePool& otherPool, uint32_t other, int forks);
+    uint32_t copySubtree(const NodePool& from, uint32_t node, vector<uint32_t>& copies);
+    int setOperationForks() const;
+    void finishSetOperation(SetTask& task, vector<uint32_t>& copies);
+
+    AVL();
+};
+
+// Commands understood by processCommand, resolved from the command word and its arguments
+enum class Opcode {
+    None,  // The line has a command word that matches nothing
+    Insert,
+    Remove,
+    SearchId,
+    SearchName,
+    PrintInorder,
+    PrintPreorder,
+    PrintPostorder,
+    PrintLevelCount,
+    RemoveInorder,
+    Load,
+    Stats,
+    SearchRange,
+    Floor,
+    Ceiling,
+    Next,
+    Prev,
+    Rank,
+    Select,
+    PrintInorderPage
+};
 
- ;  AVL();
+// A lexed command line; the views point into the line, so it must outlive the command
+struct Command {
+    Opcode opcode;
+    string_view word;    // Leading run of word characters
+    string_view name;    // Text between the quotes, empty if there is no quoted name
+    string_view number;  // Digits after the command (and name), empty if absent
+    uint64_t value;      // number as an integer, capped just past 32 bits so huge inputs can't overflow
+    string_view secondNumber;  // Another run of digits after number, for commands taking two
+    uint64_t secondValue;
 };
 
-void processCommand(const string& input, AVL& tree);
+bool parseId(string_view text, uint32_t& id);
+void printNames(OutputSink& out, TreeIterator it, uint64_t limit = UINT64_MAX);
+string formatId(uint32_t id);
+bool lexCommand(string_view line, Command& command);
+void processCommand(string_view input, AVL& tree);
+void processCommands(const vector<string>& lines, size_t count, AVL& tree);
 
 #endif  // AVL_H
@@ -0,0 +1,71 @@
+#include "ConcurrentAVL.h"
+#include <mutex>
+using namespace std;
+
+// Insert an entry under the exclusive lock
+bool ConcurrentAVL::insert(uint32_t id, string_view name) {
+    if (!AVL::validName(name)) {
+        return false;
+    }
+    unique_lock<shared_mutex> guard(lock);
+    bool duplicate = false;
+    tree.root = tree.insert(tree.root, name, id, duplicate);
+    return !duplicate;
+}
+// Remove an entry by ID under the exclusive lock
+bool ConcurrentAVL::remove(uint32_t id) {
+    unique_lock<shared_mutex> guard(lock);
+    bool removed = false;
+    tree.root = tree.removeNode(tree.root, id, removed);
+    return removed;
+}
+// Remove the nth entry in ID order under the exclusive lock
+bool ConcurrentAVL::removeInorder(int n) {
+    unique_lock<shared_mutex> guard(lock);
+    bool removed = false;
+    tree.removeInorder(n, removed);
+    return removed;
+}
+// Look up an ID under the shared lock
+bool ConcurrentAVL::searchId(uint32_t id, string& name) const {
+    shared_lock<shared_mutex> guard(lock);
+    uint32_t node = tree.findNode(id);
+    if (node == nullIndex) {
+        return false;
+    }
+    name = tree.pool[node].name;
+    return true;
+}
+// Find every ID with a name under the shared lock
+vector<uint32_t> ConcurrentAVL::searchName(string_view name) const {
+    shared_lock<shared_mutex> guard(lock);
+    return tree.idsNamed(name);
+}
+// Print the names in each order under the shared lock
+void ConcurrentAVL::printInorder(OutputSink& out) const {
+    shared_lock<shared_mutex> guard(lock);
+    printNames(out, tree.traverse(TraversalOrder::Inorder));
+}
+void ConcurrentAVL::printPreorder(OutputSink& out) const {
+    shared_lock<shared_mutex> guard(lock);
+    printNames(out, tree.traverse(TraversalOrder::Preorder));
+}
+void ConcurrentAVL::printPostorder(OutputSink& out) const {
+    shared_lock<shared_mutex> guard(lock);
+    printNames(out, tree.traverse(TraversalOrder::Postorder));
+}
+// Number of levels, which is the root's height
+int ConcurrentAVL::levelCount() const {
+    shared_lock<shared_mutex> guard(lock);
+    return tree.pool[tree.root].height;
+}
+// Number of entries
+size_t ConcurrentAVL::size() const {
+    shared_lock<shared_mutex> guard(lock);
+    return tree.pool[tree.root].size;
+}
+// Copy the tree as it is between writes
+AVL ConcurrentAVL::copy() const {
+    shared_lock<shared_mutex> guard(lock);
+    return tree;
+}
@@ -0,0 +1,29 @@
+#ifndef CONCURRENT_AVL_H  // Include guard
+#define CONCURRENT_AVL_H
+#include "AVL.h"
+#include <shared_mutex>
+using namespace std;
+
+// Thread-safe front for an AVL tree behind one reader-writer lock: lookups, traversals and the level
+// count share the lock, while insert, remove and removeInorder take it exclusively.
+// Results are returned (or printed to a sink the caller owns) instead of going to the tree's shared sink
+class ConcurrentAVL {
+public:
+    bool insert(uint32_t id, string_view name);  // false for a duplicate ID or a name AVL would reject
+    bool remove(uint32_t id);
+    bool removeInorder(int n);
+    bool searchId(uint32_t id, string& name) const;  // Copies the name out if the ID is present
+    vector<uint32_t> searchName(string_view name) const;  // IDs carrying the name, ascending
+    void printInorder(OutputSink& out) const;
+    void printPreorder(OutputSink& out) const;
+    void printPostorder(OutputSink& out) const;
+    int levelCount() const;
+    size_t size() const;
+    AVL copy() const;  // Consistent copy of the whole tree, for exports and checks
+
+private:
+    mutable shared_mutex lock;
+    AVL tree;
+};
+
+#endif  // CONCURRENT_AVL_H
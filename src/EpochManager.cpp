@@ -0,0 +1,199 @@
+#include "EpochManager.h"
+#include <thread>
+#include <mutex>
+#include <algorithm>
+using namespace std;
+
+// An object waiting to be freed, with the epoch it was retired in
+struct RetiredObject {
+    void* object;
+    void (*destroy)(void*);
+    uint64_t epoch;
+};
+
+// One thread's state in one manager. Other threads read epoch and active; depth and retired belong to
+// whichever thread holds the record, which is the one that set owned
+struct EpochRecord {
+    atomic<uint64_t> epoch;  // Epoch the thread entered its current critical section in
+    atomic<bool> active;     // Inside a Guard
+    atomic<bool> owned;      // Held by a live thread; cleared when that thread exits
+    unsigned depth;          // Guard nesting
+    vector<RetiredObject> retired;  // Oldest first
+    EpochRecord* next;
+
+    EpochRecord() : epoch(0), active(false), owned(true), depth(0), next(nullptr) {}
+};
+
+// Outlives its manager as long as some thread still caches a record of it
+struct EpochLifetime {
+    mutex lock;          // Held while the manager is torn down, and by exiting threads handing records back
+    atomic<bool> alive;
+
+    EpochLifetime() : alive(true) {}
+};
+
+// A thread's records, one per live manager it has used. On thread exit every record goes back to its
+// manager, unless the manager is already gone
+struct CachedRecord {
+    shared_ptr<EpochLifetime> manager;
+    EpochRecord* record;
+};
+struct RecordCache {
+    vector<CachedRecord> entries;
+
+    ~RecordCache() {
+        for (const CachedRecord& cached : entries) {
+            lock_guard<mutex> guard(cached.manager->lock);
+            if (cached.manager->alive.load()) {
+                cached.record->owned.store(false);  // Its retired list is adopted or taken over with the record
+            }
+        }
+    }
+};
+static thread_local RecordCache recordCache;
+
+// Start at epoch 0 with no threads
+EpochManager::EpochManager()
+    : lifetime(make_shared<EpochLifetime>()), globalEpoch(0), records(nullptr), pendingCount(0) {
+}
+// Free whatever is still retired, then the records themselves
+EpochManager::~EpochManager() {
+    {
+        lock_guard<mutex> guard(lifetime->lock);
+        lifetime->alive.store(false);  // Threads exiting from now on leave the records alone
+    }
+    EpochRecord* record = records.load();
+    while (record != nullptr) {
+        for (const RetiredObject& retired : record->retired) {
+            retired.destroy(retired.object);
+        }
+        EpochRecord* next = record->next;
+        delete record;
+        record = next;
+    }
+}
+// Find the calling thread's record, taking over an exited thread's or creating one the first time.
+// Cache entries of managers that have since been destroyed are dropped on the way
+EpochRecord* EpochManager::threadRecord() {
+    vector<CachedRecord>& cache = recordCache.entries;
+    for (size_t i = 0; i < cache.size();) {
+        if (cache[i].manager == lifetime) {
+            return cache[i].record;
+        }
+        if (!cache[i].manager->alive.load()) {
+            cache[i] = std::move(cache.back());
+            cache.pop_back();
+            continue;
+        }
+        i++;
+    }
+    EpochRecord* record = nullptr;
+    for (EpochRecord* free = records.load(); free != nullptr && record == nullptr; free = free->next) {
+        bool owned = false;
+        if (free->owned.compare_exchange_strong(owned, true)) {
+            record = free;  // Left by an exited thread, with whatever it had retired
+        }
+    }
+    if (record == nullptr) {
+        record = new EpochRecord();
+        record->next = records.load();
+        while (!records.compare_exchange_weak(record->next, record)) {
+            // Another thread registered first; record->next now holds the new head
+        }
+    }
+    cache.push_back({lifetime, record});
+    return record;
+}
+// Enter a critical section by announcing the current epoch. The epoch is read again after the announcement:
+// if it moved on in between, an advance may have missed us, so announce the new one instead
+EpochManager::Guard::Guard(EpochManager& manager) : record(manager.threadRecord()) {
+    if (record->depth++ > 0) {
+        return;  // Nested: the outer guard already protects us
+    }
+    record->active.store(true);
+    uint64_t epoch = manager.globalEpoch.load();
+    do {
+        record->epoch.store(epoch);
+        epoch = manager.globalEpoch.load();
+    } while (record->epoch.load() != epoch);
+}
+// Leave the critical section; nothing reached inside it may be used afterwards
+EpochManager::Guard::~Guard() {
+    if (--record->depth == 0) {
+        record->active.store(false);
+    }
+}
+// Hand over an unlinked object to be freed once no reader can still reach it
+void EpochManager::retire(void* object, void (*destroy)(void*)) {
+    EpochRecord* record = threadRecord();
+    record->retired.push_back({object, destroy, globalEpoch.load()});
+    pendingCount++;
+    if (record->retired.size() < collectThreshold) {
+        return;
+    }
+    adoptOrphans(record);
+    tryAdvance();
+    collect(record);
+    // Bounded garbage: past the limit, wait for the readers holding the oldest epoch to leave
+    while (record->retired.size() >= maxPending) {
+        this_thread::yield();
+        tryAdvance();
+        collect(record);
+    }
+}
+// Move the global epoch on if every thread inside a critical section has caught up with it
+bool EpochManager::tryAdvance() {
+    uint64_t epoch = globalEpoch.load();
+    for (EpochRecord* record = records.load(); record != nullptr; record = record->next) {
+        if (record->active.load() && record->epoch.load() != epoch) {
+            return false;  // A reader may still hold pointers from an older epoch
+        }
+    }
+    globalEpoch.compare_exchange_strong(epoch, epoch + 1);  // Losing the race means someone else advanced it
+    return true;
+}
+// Take over the retired lists of exited threads whose records nobody has reused yet, so their
+// garbage is freed too. Both lists are oldest first, so merging them by epoch keeps that order
+void EpochManager::adoptOrphans(EpochRecord* record) {
+    for (EpochRecord* orphan = records.load(); orphan != nullptr; orphan = orphan->next) {
+        bool owned = false;
+        if (!orphan->owned.compare_exchange_strong(owned, true)) {
+            continue;  // In use by a live thread
+        }
+        if (!orphan->retired.empty()) {
+            size_t middle = record->retired.size();
+            record->retired.insert(record->retired.end(), orphan->retired.begin(), orphan->retired.end());
+            inplace_merge(record->retired.begin(), record->retired.begin() + middle, record->retired.end(),
+                          [](const RetiredObject& a, const RetiredObject& b) { return a.epoch < b.epoch; });
+            orphan->retired.clear();
+        }
+        orphan->owned.store(false);  // Empty now, and free for the next thread to register
+    }
+}
+// Free the objects retired at least two epochs ago; readers active now entered after they were unlinked
+void EpochManager::collect(EpochRecord* record) {
+    uint64_t epoch = globalEpoch.load();
+    size_t freed = 0;
+    while (freed < record->retired.size() && record->retired[freed].epoch + 2 <= epoch) {
+        record->retired[freed].destroy(record->retired[freed].object);
+        freed++;
+    }
+    record->retired.erase(record->retired.begin(), record->retired.begin() + freed);
+    pendingCount -= freed;
+}
+// Objects retired but not freed yet
+size_t EpochManager::pending() const {
+    return pendingCount.load();
+}
+// Current global epoch
+uint64_t EpochManager::epoch() const {
+    return globalEpoch.load();
+}
+// Number of thread records on the list
+size_t EpochManager::recordCount() const {
+    size_t count = 0;
+    for (EpochRecord* record = records.load(); record != nullptr; record = record->next) {
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,64 @@
+#ifndef EPOCH_MANAGER_H  // Include guard
+#define EPOCH_MANAGER_H
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+using namespace std;
+
+struct EpochRecord;    // One thread's state in one manager, defined in EpochManager.cpp
+struct EpochLifetime;  // Whether a manager still exists, checked by exiting threads; also in EpochManager.cpp
+
+// Epoch-based memory reclamation. Readers wrap every access to shared nodes in a Guard; writers retire()
+// nodes they have unlinked instead of deleting them. A retired node is freed once the global epoch has
+// moved two steps past its retirement, which can only happen after every reader that might still see it has left.
+// Each thread retires into its own list, and no list grows past maxPending: a thread that hits the bound
+// waits for readers to move on. When a thread exits, its record is handed back: the next thread to register
+// takes it over, retired list included, and until then collect() adopts the list so its garbage still gets
+// freed. The record list therefore only grows to the peak number of threads, not the number ever seen.
+// Threads must not retire while they hold a Guard of the same manager
+class EpochManager {
+public:
+    static const size_t collectThreshold = 64;  // Retired nodes a thread gathers before trying to free some
+    static const size_t maxPending = 1024;      // Hard bound on each thread's retire list
+
+    // Read-side critical section; nodes reached inside it stay allocated until it ends. Guards may nest
+    class Guard {
+    public:
+        explicit Guard(EpochManager& manager);
+        ~Guard();
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+    private:
+        EpochRecord* record;
+    };
+
+    EpochManager();
+    ~EpochManager();  // Frees everything still retired; no thread may be using the manager any more
+    EpochManager(const EpochManager&) = delete;
+    EpochManager& operator=(const EpochManager&) = delete;
+
+    template <class T>
+    void retire(T* object) {
+        retire(object, [](void* p) { delete static_cast<T*>(p); });
+    }
+    void retire(void* object, void (*destroy)(void*));
+    size_t pending() const;  // Retired objects not freed yet, over all threads
+    uint64_t epoch() const;
+    size_t recordCount() const;  // Thread records allocated, at most the peak number of threads using the manager
+
+private:
+    shared_ptr<EpochLifetime> lifetime;  // Shared with every thread's record cache, which outlives the manager
+    atomic<uint64_t> globalEpoch;
+    atomic<EpochRecord*> records;  // Records of live threads, and of exited ones waiting to be reused; never unlinked
+    atomic<size_t> pendingCount;
+
+    EpochRecord* threadRecord();
+    bool tryAdvance();
+    void collect(EpochRecord* record);
+    void adoptOrphans(EpochRecord* record);
+};
+
+#endif  // EPOCH_MANAGER_H
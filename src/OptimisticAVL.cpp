@@ -0,0 +1,220 @@
+#include "OptimisticAVL.h"
+#include <algorithm>
+#include <thread>
+using namespace std;
+
+// A new node is a leaf at version 0
+OptimisticNode::OptimisticNode(uint32_t id, string_view name)
+    : id(id), name(name), height(1), version(0), left(nullptr), right(nullptr) {
+}
+// Start with an empty tree
+OptimisticAVL::OptimisticAVL() : root(nullptr), count(0) {
+}
+// Free the tree; removed nodes still waiting are freed by the epoch manager
+OptimisticAVL::~OptimisticAVL() {
+    destroy(root.load());
+}
+// Free a subtree; only called once no reader can be running
+void OptimisticAVL::destroy(OptimisticNode* node) {
+    if (node != nullptr) {
+        destroy(node->left.load());
+        destroy(node->right.load());
+        delete node;
+    }
+}
+// Read a node's version, waiting out a writer that is shrinking it
+uint64_t OptimisticAVL::stableVersion(const OptimisticNode* node) {
+    uint64_t version = node->version.load();
+    for (int spins = 0; version & 1; spins++) {
+        if (spins > 64) {
+            this_thread::yield();  // The writer holds it odd only for a few stores
+        }
+        version = node->version.load();
+    }
+    return version;
+}
+// Mark a node as losing IDs; readers that pass it from now on will retry
+void OptimisticAVL::beginShrink(OptimisticNode* node) {
+    node->version.fetch_add(1);
+}
+// Make a shrunk node usable again, under a version no earlier reader can match
+void OptimisticAVL::endShrink(OptimisticNode* node) {
+    node->version.fetch_add(1);
+}
+// Look up an ID without taking any lock
+bool OptimisticAVL::searchId(uint32_t id, string& name) const {
+    EpochManager::Guard guard(epochs);  // Nodes reached from here on stay allocated until we return
+    while (true) {
+        OptimisticNode* node = root.load();
+        if (node == nullptr) {
+            return false;
+        }
+        uint64_t version = stableVersion(node);
+        if (root.load() != node) {
+            continue;  // The root was rotated away before its version was read
+        }
+        while (true) {
+            if (node->id == id) {
+                name = node->name;  // Never changes once published
+                return true;
+            }
+            atomic<OptimisticNode*>& link = id < node->id ? node->left : node->right;
+            OptimisticNode* child = link.load();
+            if (child == nullptr) {
+                if (node->version.load() == version) {
+                    return false;  // The ID would have to be below here, and the node hasn't shrunk
+                }
+                break;  // Shrunk under us: start over
+            }
+            uint64_t childVersion = stableVersion(child);
+            // Hand over hand: the child must still hang from this node, and this node must not have shrunk
+            if (link.load() != child || node->version.load() != version) {
+                break;
+            }
+            node = child;
+            version = childVersion;
+        }
+    }
+}
+// Insert an entry; the new node is fully built before it is linked in
+bool OptimisticAVL::insert(uint32_t id, string_view name) {
+    lock_guard<mutex> lock(writeLock);
+    bool inserted = false;
+    insert(root, id, name, inserted);
+    if (inserted) {
+        count++;
+    }
+    return inserted;
+}
+// Remove an entry; the node is retired rather than deleted because readers may still be on it
+bool OptimisticAVL::remove(uint32_t id) {
+    lock_guard<mutex> lock(writeLock);
+    bool removed = false;
+    remove(root, id, removed);
+    if (removed) {
+        count--;
+    }
+    return removed;
+}
+// Number of entries
+size_t OptimisticAVL::size() const {
+    return count.load();
+}
+// Number of removed nodes the epoch manager still holds
+size_t OptimisticAVL::garbage() const {
+    return epochs.pending();
+}
+// Height of a possibly empty subtree
+int OptimisticAVL::height(const OptimisticNode* node) {
+    return node == nullptr ? 0 : node->height;
+}
+// Recompute a node's height from its children
+void OptimisticAVL::updateHeight(OptimisticNode* node) {
+    node->height = 1 + std::max(height(node->left.load()), height(node->right.load()));
+}
+// Insert below the node a link points at, rebalancing on the way back up
+void OptimisticAVL::insert(atomic<OptimisticNode*>& link, uint32_t id, string_view name, bool& inserted) {
+    OptimisticNode* node = link.load();
+    if (node == nullptr) {
+        link.store(new OptimisticNode(id, name));  // Publishing a new leaf takes no IDs away from anyone
+        inserted = true;
+        return;
+    }
+    if (id == node->id) {
+        return;  // Duplicate ID
+    }
+    insert(id < node->id ? node->left : node->right, id, name, inserted);
+    if (inserted) {
+        rebalance(link);
+    }
+}
+// Remove an ID below the node a link points at
+void OptimisticAVL::remove(atomic<OptimisticNode*>& link, uint32_t id, bool& removed) {
+    OptimisticNode* node = link.load();
+    if (node == nullptr) {
+        return;  // Node not found
+    }
+    if (id != node->id) {
+        remove(id < node->id ? node->left : node->right, id, removed);
+        if (removed) {
+            rebalance(link);
+        }
+        return;
+    }
+    removed = true;
+    beginShrink(node);  // Readers standing on the node must not trust it any more
+    OptimisticNode* left = node->left.load();
+    OptimisticNode* right = node->right.load();
+    if (left == nullptr || right == nullptr) {
+        link.store(left != nullptr ? left : right);  // Zero or one child: the child takes its place
+    } else {
+        // Two children: the inorder successor moves up into the node's place
+        OptimisticNode* successor = detachSmallest(node->right);
+        successor->left.store(left);
+        successor->right.store(node->right.load());
+        updateHeight(successor);
+        link.store(successor);
+        rebalance(link);
+    }
+    endShrink(node);
+    epochs.retire(node);
+}
+// Unlink the smallest node below a link. Every node on the way down loses that ID, so each is marked
+// as shrinking until the node is gone from under it
+OptimisticNode* OptimisticAVL::detachSmallest(atomic<OptimisticNode*>& link) {
+    OptimisticNode* node = link.load();
+    OptimisticNode* left = node->left.load();
+    if (left == nullptr) {
+        link.store(node->right.load());
+        return node;
+    }
+    beginShrink(node);
+    OptimisticNode* smallest = detachSmallest(node->left);
+    endShrink(node);
+    rebalance(link);
+    return smallest;
+}
+// Fix the height of the node a link points at and rotate if it is out of balance
+void OptimisticAVL::rebalance(atomic<OptimisticNode*>& link) {
+    OptimisticNode* node = link.load();
+    updateHeight(node);
+    OptimisticNode* left = node->left.load();
+    OptimisticNode* right = node->right.load();
+    int balance = height(left) - height(right);
+    if (balance > 1) {
+        if (height(left->left.load()) < height(left->right.load())) {
+            rotateLeft(node->left);  // Left-Right case
+        }
+        rotateRight(link);  // Left-Left case
+    } else if (balance < -1) {
+        if (height(right->right.load()) < height(right->left.load())) {
+            rotateRight(node->right);  // Right-Left case
+        }
+        rotateLeft(link);  // Right-Right case
+    }
+}
+// Left rotation at the node a link points at. The node moves down and loses its right child's IDs,
+// so it is the one marked; the child only gains IDs
+void OptimisticAVL::rotateLeft(atomic<OptimisticNode*>& link) {
+    OptimisticNode* node = link.load();
+    OptimisticNode* newParent = node->right.load();
+    beginShrink(node);
+    node->right.store(newParent->left.load());
+    newParent->left.store(node);
+    link.store(newParent);
+    updateHeight(node);
+    updateHeight(newParent);
+    endShrink(node);
+}
+// Right rotation at the node a link points at
+void OptimisticAVL::rotateRight(atomic<OptimisticNode*>& link) {
+    OptimisticNode* node = link.load();
+    OptimisticNode* newParent = node->left.load();
+    beginShrink(node);
+    node->left.store(newParent->right.load());
+    newParent->right.store(node);
+    link.store(newParent);
+    updateHeight(node);
+    updateHeight(newParent);
+    endShrink(node);
+}
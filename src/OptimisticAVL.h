@@ -0,0 +1,67 @@
+#ifndef OPTIMISTIC_AVL_H  // Include guard
+#define OPTIMISTIC_AVL_H
+#include "EpochManager.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+using namespace std;
+
+// Node of an OptimisticAVL. ID and name never change after the node is published; the links are atomic so
+// readers can follow them while a writer restructures, and the version tells readers when to retry
+class OptimisticNode {
+public:
+    const uint32_t id;
+    const string name;
+    int height;  // Only used by the writer
+    atomic<uint64_t> version;  // Odd while the node's subtree is losing IDs (rotated down or emptied by a removal)
+    atomic<OptimisticNode*> left;
+    atomic<OptimisticNode*> right;
+
+    OptimisticNode(uint32_t id, string_view name);
+};
+
+// Concurrent AVL tree with optimistic, lock-free reads in the style of hand-over-hand version validation:
+// a search writes nothing but its own thread's epoch record, so readers never contend on a cache line.
+// At each step it reads a node's version, follows a child link, then checks that the link and the
+// version are unchanged, restarting from the root if a writer got in between.
+// Writers are serialized by one mutex and bump the version of every node whose set of reachable IDs shrinks,
+// so a reader can never be misled into a subtree that no longer holds the ID it is looking for.
+// Searches run inside an epoch guard and removed nodes are retired to the epoch manager, so a node is freed
+// only once no reader can still be standing on it
+class OptimisticAVL {
+public:
+    OptimisticAVL();
+    ~OptimisticAVL();
+    OptimisticAVL(const OptimisticAVL&) = delete;
+    OptimisticAVL& operator=(const OptimisticAVL&) = delete;
+
+    bool insert(uint32_t id, string_view name);  // false if the ID is already present
+    bool remove(uint32_t id);                    // false if the ID is absent
+    bool searchId(uint32_t id, string& name) const;  // Lock-free; copies the name out if the ID is present
+    size_t size() const;
+    size_t garbage() const;  // Removed nodes not freed yet
+
+private:
+    atomic<OptimisticNode*> root;
+    mutex writeLock;
+    atomic<size_t> count;
+    mutable EpochManager epochs;  // Frees removed nodes once readers have moved on
+
+    static uint64_t stableVersion(const OptimisticNode* node);
+    static void beginShrink(OptimisticNode* node);
+    static void endShrink(OptimisticNode* node);
+    static int height(const OptimisticNode* node);
+    static void updateHeight(OptimisticNode* node);
+    void insert(atomic<OptimisticNode*>& link, uint32_t id, string_view name, bool& inserted);
+    void remove(atomic<OptimisticNode*>& link, uint32_t id, bool& removed);
+    OptimisticNode* detachSmallest(atomic<OptimisticNode*>& link);
+    void rebalance(atomic<OptimisticNode*>& link);
+    void rotateLeft(atomic<OptimisticNode*>& link);
+    void rotateRight(atomic<OptimisticNode*>& link);
+    static void destroy(OptimisticNode* node);
+};
+
+#endif  // OPTIMISTIC_AVL_H
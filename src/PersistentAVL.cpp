@@ -0,0 +1,153 @@
+#include "PersistentAVL.h"
+#include <algorithm>
+using namespace std;
+
+// Build a node over two finished subtrees, deriving its height and size from them
+PersistentNode::PersistentNode(SharedName name, uint32_t id, shared_ptr<const PersistentNode> left, shared_ptr<const PersistentNode> right)
+    : name(std::move(name)), id(id), left(std::move(left)), right(std::move(right)) {
+    height = 1 + std::max(this->left ? this->left->height : 0, this->right ? this->right->height : 0);
+    size = 1 + (this->left ? this->left->size : 0) + (this->right ? this->right->size : 0);
+}
+// Height of a possibly empty subtree
+static int heightOf(const PersistentRef& node) {
+    return node ? node->height : 0;
+}
+// Number of nodes in this version
+uint32_t Snapshot::size() const {
+    return root ? root->size : 0;
+}
+// Height of this version, 0 when it is empty
+int Snapshot::height() const {
+    return heightOf(root);
+}
+// Look up an ID in this version
+const PersistentNode* Snapshot::find(uint32_t id) const {
+    const PersistentNode* node = root.get();
+    while (node != nullptr && node->id != id) {
+        node = id < node->id ? node->left.get() : node->right.get();
+    }
+    return node;
+}
+// Print the names in ID order, separated by commas; the version can't change underneath
+void Snapshot::printInorder(OutputSink& out) const {
+    vector<const PersistentNode*> stack;  // Only the current path, like TreeIterator
+    const PersistentNode* node = root.get();
+    bool first = true;
+    while (node != nullptr || !stack.empty()) {
+        while (node != nullptr) {
+            stack.push_back(node);
+            node = node->left.get();
+        }
+        node = stack.back();
+        stack.pop_back();
+        if (!first) {
+            out.write(", ");  // Print comma between nodes, but not after the last one
+        }
+        out.write(*node->name);
+        first = false;
+        node = node->right.get();
+    }
+    out.writeLine();  // Newline after printing all nodes
+}
+// Add an entry as a new version; the previous version stays intact for any snapshot holding it
+bool PersistentAVL::insert(uint32_t id, string_view name) {
+    lock_guard<mutex> lock(writeLock);
+    bool inserted = false;
+    PersistentRef next = insert(atomic_load(&root), id, name, inserted);
+    if (inserted) {
+        atomic_store(&root, next);  // Publish the new version to snapshot()
+    }
+    return inserted;
+}
+// Remove an entry as a new version
+bool PersistentAVL::remove(uint32_t id) {
+    lock_guard<mutex> lock(writeLock);
+    bool removed = false;
+    PersistentRef next = remove(atomic_load(&root), id, removed);
+    if (removed) {
+        atomic_store(&root, next);
+    }
+    return removed;
+}
+// Take the current version. O(1): it only shares the root
+Snapshot PersistentAVL::snapshot() const {
+    return Snapshot{atomic_load(&root)};
+}
+// Insert below a node, returning the new subtree root; the copies are made on the way back up
+PersistentRef PersistentAVL::insert(const PersistentRef& node, uint32_t id, string_view name, bool& inserted) {
+    if (!node) {
+        inserted = true;
+        return make_shared<const PersistentNode>(make_shared<const string>(name), id, nullptr, nullptr);  // The only name copy
+    }
+    if (id == node->id) {
+        inserted = false;  // Duplicate IDs are rejected, as in AVL
+        return node;
+    }
+    if (id < node->id) {
+        PersistentRef left = insert(node->left, id, name, inserted);
+        return inserted ? balance(*node, std::move(left), node->right) : node;
+    }
+    PersistentRef right = insert(node->right, id, name, inserted);
+    return inserted ? balance(*node, node->left, std::move(right)) : node;
+}
+// Remove an ID below a node, returning the new subtree root
+PersistentRef PersistentAVL::remove(const PersistentRef& node, uint32_t id, bool& removed) {
+    if (!node) {
+        removed = false;  // Node not found
+        return node;
+    }
+    if (id < node->id) {
+        PersistentRef left = remove(node->left, id, removed);
+        return removed ? balance(*node, std::move(left), node->right) : node;
+    }
+    if (id > node->id) {
+        PersistentRef right = remove(node->right, id, removed);
+        return removed ? balance(*node, node->left, std::move(right)) : node;
+    }
+    removed = true;
+    if (!node->left) {
+        return node->right;  // Zero or one child: the child takes its place
+    }
+    if (!node->right) {
+        return node->left;
+    }
+    // Two children: the inorder successor takes the node's place
+    PersistentRef successor;
+    PersistentRef right = removeSmallest(node->right, successor);
+    return balance(*successor, node->left, std::move(right));
+}
+// Take the smallest node out of a subtree, returning the new subtree root
+PersistentRef PersistentAVL::removeSmallest(const PersistentRef& node, PersistentRef& smallest) {
+    if (!node->left) {
+        smallest = node;
+        return node->right;
+    }
+    PersistentRef left = removeSmallest(node->left, smallest);
+    return balance(*node, std::move(left), node->right);
+}
+// Copy a node over new children, rotating if they differ in height by more than one
+PersistentRef PersistentAVL::balance(const PersistentNode& node, PersistentRef left, PersistentRef right) {
+    if (heightOf(left) > heightOf(right) + 1) {
+        if (heightOf(left->left) < heightOf(left->right)) {
+            left = rotateLeft(*left, left->left, left->right);  // Left-Right case
+        }
+        return rotateRight(node, left, right);  // Left-Left case
+    }
+    if (heightOf(right) > heightOf(left) + 1) {
+        if (heightOf(right->right) < heightOf(right->left)) {
+            right = rotateRight(*right, right->left, right->right);  // Right-Left case
+        }
+        return rotateLeft(node, left, right);  // Right-Right case
+    }
+    return make_shared<const PersistentNode>(node.name, node.id, std::move(left), std::move(right));
+}
+// Left rotation of a node with the given children, building copies of the two nodes that move
+PersistentRef PersistentAVL::rotateLeft(const PersistentNode& node, const PersistentRef& left, const PersistentRef& right) {
+    PersistentRef newLeft = make_shared<const PersistentNode>(node.name, node.id, left, right->left);
+    return make_shared<const PersistentNode>(right->name, right->id, std::move(newLeft), right->right);
+}
+// Right rotation of a node with the given children
+PersistentRef PersistentAVL::rotateRight(const PersistentNode& node, const PersistentRef& left, const PersistentRef& right) {
+    PersistentRef newRight = make_shared<const PersistentNode>(node.name, node.id, left->right, right);
+    return make_shared<const PersistentNode>(left->name, left->id, left->left, std::move(newRight));
+}
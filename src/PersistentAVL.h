@@ -0,0 +1,59 @@
+#ifndef PERSISTENT_AVL_H  // Include guard
+#define PERSISTENT_AVL_H
+#include "AVL.h"
+#include <memory>
+#include <mutex>
+using namespace std;
+
+// Name of a persistent entry, shared by every copy of its node so path copies only duplicate links
+typedef shared_ptr<const string> SharedName;
+
+// Node of a persistent tree. Nodes are never changed once built, so any number of versions can share them
+class PersistentNode {
+public:
+    SharedName name;
+    uint32_t id;
+    int height;
+    uint32_t size;  // Number of nodes in this subtree
+    shared_ptr<const PersistentNode> left;
+    shared_ptr<const PersistentNode> right;
+
+    PersistentNode(SharedName name, uint32_t id, shared_ptr<const PersistentNode> left, shared_ptr<const PersistentNode> right);
+};
+
+typedef shared_ptr<const PersistentNode> PersistentRef;
+
+// Frozen version of a persistent tree. Holding it keeps exactly that version alive;
+// the nodes it alone still uses are freed when the last copy of it goes away
+class Snapshot {
+public:
+    PersistentRef root;
+
+    uint32_t size() const;
+    int height() const;
+    const PersistentNode* find(uint32_t id) const;  // nullptr if the ID is absent
+    void printInorder(OutputSink& out) const;       // Same format as printInorder on an AVL
+};
+
+// AVL tree with path copying: insert and remove (rotations included) build new copies of the O(log n)
+// nodes on the modified path and share everything else with the previous version, so snapshot() is O(1).
+// Writers are serialized by an internal lock; readers work on snapshots and never block them
+class PersistentAVL {
+public:
+    bool insert(uint32_t id, string_view name);  // false if the ID is already present
+    bool remove(uint32_t id);                    // false if the ID is absent
+    Snapshot snapshot() const;
+
+private:
+    PersistentRef root;  // Current version; read and replaced with the atomic shared_ptr functions
+    mutex writeLock;
+
+    static PersistentRef insert(const PersistentRef& node, uint32_t id, string_view name, bool& inserted);
+    static PersistentRef remove(const PersistentRef& node, uint32_t id, bool& removed);
+    static PersistentRef removeSmallest(const PersistentRef& node, PersistentRef& smallest);
+    static PersistentRef balance(const PersistentNode& node, PersistentRef left, PersistentRef right);
+    static PersistentRef rotateLeft(const PersistentNode& node, const PersistentRef& left, const PersistentRef& right);
+    static PersistentRef rotateRight(const PersistentNode& node, const PersistentRef& left, const PersistentRef& right);
+};
+
+#endif  // PERSISTENT_AVL_H
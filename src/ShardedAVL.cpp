@@ -0,0 +1,240 @@
+#include "ShardedAVL.h"
+#include <algorithm>
+#include <cstdlib>
+using namespace std;
+
+// Split the ID space into equal ranges; with 10 shards each holds one leading digit
+ShardedAVL::ShardedAVL(size_t shardCount, size_t minSplitSize) : minSplitSize(minSplitSize), count(0) {
+    shardCount = std::max<size_t>(shardCount, 1);
+    for (size_t i = 0; i < shardCount; i++) {
+        shards.push_back(make_unique<Shard>());
+        shards.back()->low = static_cast<uint32_t>(uint64_t(idLimit) * i / shardCount);
+    }
+}
+// The shard whose range holds an ID; the caller holds layoutLock
+Shard& ShardedAVL::shardFor(uint32_t id) const {
+    auto next = upper_bound(shards.begin(), shards.end(), id,
+                            [](uint32_t key, const unique_ptr<Shard>& shard) { return key < shard->low; });
+    return **(next - 1);  // shards[0] starts at 0, so there is always one
+}
+// Lock every shard, always in ID order so two callers can't deadlock; the caller holds layoutLock
+vector<unique_lock<mutex>> ShardedAVL::lockAll() const {
+    vector<unique_lock<mutex>> locks;
+    locks.reserve(shards.size());
+    for (const unique_ptr<Shard>& shard : shards) {
+        locks.emplace_back(shard->lock);
+    }
+    return locks;
+}
+// Whether a shard of this size has outgrown the others
+bool ShardedAVL::needsSplit(size_t shardSize) const {
+    return shardSize >= minSplitSize && shardSize > splitFactor * count.load() / shards.size();
+}
+// Insert under the lock of the one shard that owns the ID
+bool ShardedAVL::insert(uint32_t id, string_view name) {
+    if (id >= idLimit || !AVL::validName(name)) {
+        return false;
+    }
+    bool tooBig = false;
+    {
+        shared_lock<shared_mutex> layout(layoutLock);
+        Shard& shard = shardFor(id);
+        lock_guard<mutex> guard(shard.lock);
+        bool duplicate = false;
+        shard.tree.root = shard.tree.insert(shard.tree.root, name, id, duplicate);
+        if (duplicate) {
+            return false;
+        }
+        count++;
+        tooBig = needsSplit(shard.tree.nodeSize(shard.tree.root));
+    }
+    if (tooBig) {
+        split(id);  // Needs the layout lock exclusively, so only after letting go of it
+    }
+    return true;
+}
+// Remove under the lock of the owning shard
+bool ShardedAVL::remove(uint32_t id) {
+    if (id >= idLimit) {
+        return false;
+    }
+    shared_lock<shared_mutex> layout(layoutLock);
+    Shard& shard = shardFor(id);
+    lock_guard<mutex> guard(shard.lock);
+    bool removed = false;
+    shard.tree.root = shard.tree.removeNode(shard.tree.root, id, removed);
+    if (removed) {
+        count--;
+    }
+    return removed;
+}
+// Look up an ID in its shard
+bool ShardedAVL::searchId(uint32_t id, string& name) const {
+    if (id >= idLimit) {
+        return false;
+    }
+    shared_lock<shared_mutex> layout(layoutLock);
+    Shard& shard = shardFor(id);
+    lock_guard<mutex> guard(shard.lock);
+    uint32_t node = shard.tree.findNode(id);
+    if (node == nullIndex) {
+        return false;
+    }
+    name = shard.tree.pool[node].name;
+    return true;
+}
+// Every shard may hold the name; shards are in ID order, so appending keeps the IDs sorted
+vector<uint32_t> ShardedAVL::searchName(string_view name) const {
+    shared_lock<shared_mutex> layout(layoutLock);
+    vector<unique_lock<mutex>> locks = lockAll();
+    vector<uint32_t> ids;
+    for (const unique_ptr<Shard>& shard : shards) {
+        vector<uint32_t> found = shard->tree.idsNamed(name);
+        ids.insert(ids.end(), found.begin(), found.end());
+    }
+    return ids;
+}
+// Print all names in ID order, shard after shard, as one comma-separated line
+void ShardedAVL::printInorder(OutputSink& out) const {
+    shared_lock<shared_mutex> layout(layoutLock);
+    vector<unique_lock<mutex>> locks = lockAll();
+    bool first = true;
+    for (const unique_ptr<Shard>& shard : shards) {
+        for (TreeIterator it = shard->tree.traverse(TraversalOrder::Inorder); !it.done(); it.next()) {
+            if (!first) {
+                out.write(", ");  // Print comma between nodes, but not after the last one
+            }
+            out.write((*it).name);
+            first = false;
+        }
+    }
+    out.writeLine();
+}
+// Remove the nth entry over all shards by skipping whole shards by their sizes
+bool ShardedAVL::removeInorder(int n) {
+    shared_lock<shared_mutex> layout(layoutLock);
+    vector<unique_lock<mutex>> locks = lockAll();
+    if (n < 0) {
+        return false;
+    }
+    size_t position = static_cast<size_t>(n);
+    for (const unique_ptr<Shard>& shard : shards) {
+        size_t shardSize = shard->tree.nodeSize(shard->tree.root);
+        if (position < shardSize) {
+            bool removed = false;
+            shard->tree.removeInorder(static_cast<int>(position), removed);
+            if (removed) {
+                count--;
+            }
+            return removed;
+        }
+        position -= shardSize;
+    }
+    return false;  // Past the last entry
+}
+// Levels of the shards seen as one tree: the height AVL::join gives when the non-empty shards are joined
+// in ID order. Trees within one level of each other get a new root above both; a shorter tree is hung off
+// the taller one's spine, which keeps its height. No tree of that many entries can be shorter than a
+// perfectly balanced one, which covers the spine filling up. One shard, or one entry, reads as AVL does
+int ShardedAVL::levelCount() const {
+    shared_lock<shared_mutex> layout(layoutLock);
+    vector<unique_lock<mutex>> locks = lockAll();
+    int levels = 0;
+    uint64_t entries = 0;
+    for (const unique_ptr<Shard>& shard : shards) {
+        int height = shard->tree.nodeHeight(shard->tree.root);
+        if (height == 0) {
+            continue;  // An empty shard adds nothing to the joined tree
+        }
+        entries += shard->tree.nodeSize(shard->tree.root);
+        if (levels == 0) {
+            levels = height;
+            continue;
+        }
+        levels = abs(levels - height) <= 1 ? std::max(levels, height) + 1 : std::max(levels, height);
+        int balanced = 0;
+        while ((uint64_t(1) << balanced) <= entries) {
+            balanced++;  // ceil(log2(entries + 1)): the height of a perfectly balanced tree
+        }
+        levels = std::max(levels, balanced);
+    }
+    return levels;
+}
+// Number of entries over all shards
+size_t ShardedAVL::size() const {
+    return count.load();
+}
+// Number of shards, which grows as shards are split
+size_t ShardedAVL::shardCount() const {
+    shared_lock<shared_mutex> layout(layoutLock);
+    return shards.size();
+}
+// Cut the shard holding an ID in two at its median, if it is still too big once we have the layout to ourselves
+void ShardedAVL::split(uint32_t id) {
+    unique_lock<shared_mutex> layout(layoutLock);
+    Shard& shard = shardFor(id);
+    uint32_t shardSize = shard.tree.nodeSize(shard.tree.root);
+    if (!needsSplit(shardSize)) {
+        return;  // Another thread split it first, or it has shrunk
+    }
+    uint32_t median = shard.tree.pool[shard.tree.selectNode(shardSize / 2)].id;
+    vector<pair<uint32_t, string>> upper;
+    upper.reserve(shardSize - shardSize / 2);
+    for (TreeIterator it = shard.tree.lowerBound(median); !it.done(); it.next()) {
+        upper.emplace_back((*it).id, (*it).name);
+    }
+    unique_ptr<Shard> upperShard = make_unique<Shard>();
+    upperShard->low = median;
+    upperShard->tree.bulkLoad(std::move(upper));  // Sorted, so the new shard is built in linear time
+    shard.tree.differenceWith(upperShard->tree);
+    auto position = upper_bound(shards.begin(), shards.end(), median,
+                                [](uint32_t key, const unique_ptr<Shard>& s) { return key < s->low; });
+    shards.insert(position, std::move(upperShard));
+}
+// Run one command line, writing its result to the caller's sink. Commands that only make sense for a
+// single tree (traversal orders, ranges, stats and so on) are unsuccessful here
+void ShardedAVL::execute(string_view line, OutputSink& out) {
+    Command command;
+    uint32_t id = 0;
+    if (!lexCommand(line, command)) {
+        out.writeLine("unsuccessful");
+        return;
+    }
+    switch (command.opcode) {
+        case Opcode::Insert:
+            out.writeLine(parseId(command.number, id) && insert(id, command.name) ? "successful" : "unsuccessful");
+            break;
+        case Opcode::Remove:
+            out.writeLine(parseId(command.number, id) && remove(id) ? "successful" : "unsuccessful");
+            break;
+        case Opcode::SearchId: {
+            string name;
+            out.writeLine(parseId(command.number, id) && searchId(id, name) ? name : "unsuccessful");
+            break;
+        }
+        case Opcode::SearchName: {
+            vector<uint32_t> ids = searchName(command.name);
+            for (uint32_t found : ids) {
+                out.writeLine(formatId(found));
+            }
+            if (ids.empty()) {
+                out.writeLine("unsuccessful");
+            }
+            break;
+        }
+        case Opcode::PrintInorder:
+            printInorder(out);
+            break;
+        case Opcode::PrintLevelCount:
+            out.writeLine(to_string(levelCount()));
+            break;
+        case Opcode::RemoveInorder:
+            out.writeLine(removeInorder(static_cast<int>(min<uint64_t>(command.value, INT32_MAX))) ? "successful" : "unsuccessful");
+            break;
+        case Opcode::None:
+            break;
+        default:
+            out.writeLine("unsuccessful");
+            break;
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef SHARDED_AVL_H  // Include guard
+#define SHARDED_AVL_H
+#include "AVL.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+using namespace std;
+
+// One ID range of a ShardedAVL: IDs from low up to the next shard's low live in tree
+struct Shard {
+    uint32_t low;
+    mutex lock;
+    AVL tree;
+};
+
+// Front end that partitions the ID space into independent AVL trees, each behind its own lock, so
+// inserts and lookups on different shards run in parallel. Commands that need the whole tree lock every
+// shard in ID order and combine them, so printInorder and removeInorder answer as one tree would.
+// printLevelCount reports the height of the tree AVL::join would build from the non-empty shards in ID order,
+// so one shard or one entry reads as a single AVL. A shard that grows past splitFactor times the average is
+// cut in two at its median ID
+class ShardedAVL {
+public:
+    static const uint32_t idLimit = 100000000;  // IDs have 8 digits
+    static const size_t splitFactor = 2;
+    size_t minSplitSize;  // Shards smaller than this are never split
+
+    explicit ShardedAVL(size_t shardCount = 8, size_t minSplitSize = 4096);  // Starts with equal ID ranges
+    ShardedAVL(const ShardedAVL&) = delete;
+    ShardedAVL& operator=(const ShardedAVL&) = delete;
+
+    bool insert(uint32_t id, string_view name);
+    bool remove(uint32_t id);
+    bool searchId(uint32_t id, string& name) const;
+    vector<uint32_t> searchName(string_view name) const;  // Ascending IDs over all shards
+    void printInorder(OutputSink& out) const;
+    bool removeInorder(int n);
+    int levelCount() const;
+    size_t size() const;
+    size_t shardCount() const;
+    void execute(string_view line, OutputSink& out);  // processCommand for the sharded tree; safe to call from many threads
+
+private:
+    mutable shared_mutex layoutLock;  // Shared by every command, exclusive while shards are re-split
+    vector<unique_ptr<Shard>> shards;  // Ordered by low; shards[0]->low is 0
+    atomic<size_t> count;
+
+    Shard& shardFor(uint32_t id) const;
+    vector<unique_lock<mutex>> lockAll() const;
+    bool needsSplit(size_t shardSize) const;
+    void split(uint32_t id);
+};
+
+#endif  // SHARDED_AVL_H
@@ -1,18 +1,54 @@
-#include "AVL.h"
-#include <iostream>
-#include <string>
-using namespace std;
-
-
-int main() {
-    AVL tree;
-    // Example input
-    string input;
-
-    // Simulate user input
-    while (getline(cin, input)) {
-        processCommand(input, tree);
-    }
-
-    return 0;
-}
+#include "AVL.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#ifdef _WIN32
+#include <io.h>
+#define isatty _isatty
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+using namespace std;
+
+
+int main(int argc, char* argv[]) {
+    ios::sync_with_stdio(false);  // All output goes through the buffered sink anyway
+    AVL tree;
+    // Big prints are formatted on every core; the output is the same as on one
+    tree.threads = max(1u, thread::hardware_concurrency());
+    // Someone typing commands wants each answer right away; batch replays only need it at the end
+    bool interactive = isatty(fileno(stdin)) != 0;
+    standardOutput().lineBuffered = interactive;
+    // Example input
+    string input;
+    // --batch-inserts merges runs of inserts in one pass. The same entries end up in the tree, but its
+    // shape (and so printPreorder, printPostorder and printLevelCount) can differ from inserting one by one
+    bool batchInserts = argc > 1 && strcmp(argv[1], "--batch-inserts") == 0;
+
+    if (interactive || !batchInserts) {
+        // Simulate user input
+        while (getline(cin, input)) {
+            processCommand(input, tree);
+        }
+    } else {
+        // Replayed files are read a chunk of lines at a time so runs of inserts can be merged in one pass
+        const size_t chunkLines = 4096;
+        vector<string> lines(chunkLines);
+        size_t count = 0;
+        while (getline(cin, lines[count])) {
+            if (++count == chunkLines) {
+                processCommands(lines, count, tree);
+                count = 0;
+            }
+        }
+        processCommands(lines, count, tree);
+    }
+
+    standardOutput().flush();  // End of input
+    return 0;
+}
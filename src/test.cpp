@@ -2,7 +2,32 @@
 #include <catch2/catch_test_macros.hpp>
 #include <sstream>
 #include "AVL.h"
+#include "PersistentAVL.h"
+#include "ConcurrentAVL.h"
+#include "OptimisticAVL.h"
+#include "EpochManager.h"
+#include "ShardedAVL.h"
 #include <iostream>
+#include <map>
+#include <random>
+#include <regex>
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <unordered_set>
+
+// A tree whose command output is collected in memory; TEST_CASE_METHOD tests see tree, output and sink directly
+struct CapturedTree {
+    AVL tree;
+    std::ostringstream output;
+    OutputSink sink;
+    CapturedTree() : sink(output) { tree.out = &sink; }
+};
 
 TEST_CASE("Test Incorrect Commands", "[commands]") {
     AVL tree;
@@ -133,3 +158,1434 @@ TEST_CASE("Insert 100 Nodes and Remove 10", "[large_test]") {
         REQUIRE_NOTHROW(tree.printInOrderHelper());
     }
 }
+
+TEST_CASE("Packed IDs", "[ids]") {
+    AVL tree;
+    SECTION("IDs round-trip through the packed form") {
+        uint32_t id = 0;
+        REQUIRE(parseId("00000042", id));
+        REQUIRE(id == 42);
+        REQUIRE(formatId(id) == "00000042");
+        REQUIRE_FALSE(parseId("1234567", id));
+        REQUIRE_FALSE(parseId("1234567a", id));
+        REQUIRE_FALSE(parseId("1234567\xb9", id));  // Bytes above 0x7f are not digits
+    }
+    SECTION("Name search prints zero-padded IDs") {
+        std::ostringstream output;
+        OutputSink sink(output);
+        tree.out = &sink;
+        tree.insertHelper("00000042", "Small");
+        tree.insertHelper("12345678", "Large");
+        tree.searchNameHelper("Small");
+        sink.flush();
+        REQUIRE(output.str() == "successful\nsuccessful\n00000042\n");
+    }
+}
+
+TEST_CASE_METHOD(CapturedTree, "Node pool recycles slots", "[pool]") {
+    for (int i = 0; i < 5000; ++i) {
+        tree.insertHelper(std::to_string(10000000 + i), "Node");
+    }
+    size_t chunks = tree.pool.chunksAllocated;
+    // Churn: every removal frees a slot that the next insert picks back up
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < 5000; i += 2) {
+            tree.removeHelper(std::to_string(10000000 + i));
+        }
+        for (int i = 0; i < 5000; i += 2) {
+            tree.insertHelper(std::to_string(10000000 + i), "Node");
+        }
+    }
+    sink.flush();
+    REQUIRE(tree.pool.chunksAllocated == chunks);
+    REQUIRE(tree.pool.liveNodes == 5000);
+    REQUIRE(tree.pool.nodesReused == 3 * 2500);
+}
+
+TEST_CASE("Node pool grows without moving nodes", "[pool]") {
+    NodePool pool;
+    uint32_t first = pool.allocate("First", 1);
+    const Node* address = &pool[first];
+    for (uint32_t id = 2; id < 3 * NodePool::chunkSize; id++) {
+        pool.allocate("Node", id);
+    }
+    REQUIRE(&pool[first] == address);
+    REQUIRE(pool.chunksAllocated == 3);
+
+    NodePool copy = pool;  // A copy keeps the indices and can grow on its own
+    uint32_t added = copy.allocate("Added", 0);
+    REQUIRE(added == 3 * NodePool::chunkSize);
+    REQUIRE(copy[first].name == "First");
+    REQUIRE(copy[added].name == "Added");
+    REQUIRE(copy[added - 1].id == 3 * NodePool::chunkSize - 1);
+}
+
+TEST_CASE_METHOD(CapturedTree, "Index-linked trees copy wholesale", "[pool]") {
+    tree.insertHelper("20000000", "Root");
+    tree.insertHelper("10000000", "Left");
+    tree.insertHelper("30000000", "Right");
+    AVL clone = tree;  // Links are indices, so copying the pool copies the tree
+    tree.removeHelper("10000000");
+    tree.removeHelper("20000000");
+    sink.flush();
+    output.str("");
+    clone.printInOrderHelper();
+    tree.printInOrderHelper();
+    sink.flush();
+    REQUIRE(output.str() == "Left, Root, Right\nRight\n");
+}
+
+// Walk a subtree checking ordering, heights, sizes and balance; returns the subtree size
+static int checkSubtree(AVL& tree, uint32_t node, long long low, long long high) {
+    if (node == nullIndex) {
+        return 0;
+    }
+    const Node& n = tree.pool[node];
+    REQUIRE(n.id > low);
+    REQUIRE(n.id < high);
+    int leftSize = checkSubtree(tree, n.left, low, n.id);
+    int rightSize = checkSubtree(tree, n.right, n.id, high);
+    int leftHeight = tree.pool[n.left].height;
+    int rightHeight = tree.pool[n.right].height;
+    REQUIRE(n.height == 1 + std::max(leftHeight, rightHeight));
+    REQUIRE(std::abs(leftHeight - rightHeight) <= 1);
+    REQUIRE(n.size == static_cast<uint32_t>(1 + leftSize + rightSize));
+    return 1 + leftSize + rightSize;
+}
+
+// Check a tree against the entries it should hold, including its counters and name index
+static void checkAgainst(AVL& tree, const std::map<uint32_t, std::string>& expected) {
+    REQUIRE(checkSubtree(tree, tree.root, -1, 1LL << 32) == static_cast<int>(expected.size()));
+    REQUIRE(tree.pool.liveNodes == expected.size());
+    auto entry = expected.begin();
+    std::vector<uint32_t> heights;
+    for (TreeIterator it = tree.traverse(TraversalOrder::Inorder); !it.done(); it.next(), ++entry) {
+        REQUIRE((*it).id == entry->first);
+        REQUIRE((*it).name == entry->second);
+        heights.resize(std::max<size_t>(heights.size(), (*it).height + 1));
+        heights[(*it).height]++;
+    }
+    REQUIRE(tree.heightCounts == heights);
+    size_t indexed = 0;
+    for (const auto& named : tree.nameIndex) {
+        for (uint32_t id : named.second) {
+            REQUIRE(expected.at(id) == named.first);
+        }
+        indexed += named.second.size();
+    }
+    REQUIRE(indexed == expected.size());
+}
+
+// The entries a tree holds, in ID order
+static std::map<uint32_t, std::string> entriesOf(const AVL& tree) {
+    std::map<uint32_t, std::string> entries;
+    for (TreeIterator it = tree.traverse(TraversalOrder::Inorder); !it.done(); it.next()) {
+        entries.emplace((*it).id, (*it).name);
+    }
+    return entries;
+}
+
+TEST_CASE_METHOD(CapturedTree, "Randomized operations keep the tree valid", "[random]") {
+    std::map<uint32_t, std::string> reference;
+    std::mt19937 rng(12345);
+    const std::string names[] = {"Ann", "Bob", "Cy"};
+    for (int step = 0; step < 4000; ++step) {
+        uint32_t id = 10000000 + rng() % 2000;
+        int op = rng() % 3;
+        if (op == 0) {
+            std::string name = names[rng() % 3];
+            tree.insertHelper(formatId(id), name);
+            reference.emplace(id, name);
+        } else if (op == 1) {
+            tree.removeHelper(formatId(id));
+            reference.erase(id);
+        } else if (!reference.empty()) {
+            int n = rng() % reference.size();
+            tree.removeInorderHelper(n);
+            reference.erase(std::next(reference.begin(), n));
+        }
+    }
+    sink.flush();
+    checkAgainst(tree, reference);
+    std::vector<uint32_t> nodes;
+    tree.inorderTraversal(tree.root, nodes);
+    auto it = reference.begin();
+    int position = 0;
+    for (uint32_t node : nodes) {
+        REQUIRE(tree.pool[node].id == (it++)->first);
+        REQUIRE(tree.rankOf(tree.pool[node].id) == position);
+        TreeIterator page(tree.pool, nullIndex, TraversalOrder::Inorder);
+        page.seekRank(tree.root, position);
+        REQUIRE(page.node() == node);
+        REQUIRE(tree.selectNode(position++) == node);
+    }
+    REQUIRE(tree.selectNode(position) == nullIndex);
+    for (const std::string& name : names) {
+        std::string expected;
+        for (const auto& entry : reference) {
+            if (entry.second == name) {
+                expected += formatId(entry.first) + "\n";
+            }
+        }
+        std::ostringstream found;
+        OutputSink foundSink(found);
+        tree.out = &foundSink;
+        tree.searchNameHelper(name);
+        foundSink.flush();
+        REQUIRE(found.str() == (expected.empty() ? "unsuccessful\n" : expected));
+    }
+}
+
+TEST_CASE_METHOD(CapturedTree, "Name search uses the name index", "[names]") {
+    tree.insertHelper("30000000", "Sam");
+    tree.insertHelper("10000000", "Sam");
+    tree.insertHelper("20000000", "Alex");
+    tree.insertHelper("40000000", "Sam");
+    tree.removeHelper("40000000");
+    tree.removeInorderHelper(1);  // Removes Alex
+    sink.flush();
+    output.str("");
+    tree.searchNameHelper("Sam");
+    tree.searchNameHelper("Alex");
+    sink.flush();
+    REQUIRE(output.str() == "10000000\n30000000\nunsuccessful\n");
+    REQUIRE(tree.nameIndex.size() == 1);
+}
+
+TEST_CASE("Command lexer matches the regex grammar", "[commands]") {
+    // The grammar processCommand has always accepted, as a regex
+    std::regex commandRegex("(\\w+)(?:\\s+\"([^\"]+)\")?(?:\\s+(\\d+))?");
+    auto agree = [&](const std::string& line) {
+        std::smatch match;
+        Command command;
+        bool matched = std::regex_search(line, match, commandRegex);
+        INFO("line: [" << line << "]");
+        REQUIRE(lexCommand(line, command) == matched);
+        if (matched) {
+            REQUIRE(command.word == match[1].str());
+            REQUIRE(command.name == match[2].str());
+            REQUIRE(command.number == match[3].str());
+        }
+    };
+
+    SECTION("Hand-picked lines") {
+        const char* lines[] = {
+            "insert \"Adam\" 12345678", "search 12345678", "search \"Adam\"", "printInorder",
+            "removeInorder 2", "  insert   \"Two Words\"\t45679999  ", "insert \"\" 12345678",
+            "insert \"Unclosed 12345678", "insert\"Adam\" 12345678", "insert \"Adam\"12345678",
+            "remove 1234abcd", "\"Adam\" insert", "--- 77", "", "   ", "5", "search \"A\" \"B\" 1",
+            "printLevelCount extra words", "x_1 \"q\" 9 8",
+        };
+        for (const char* line : lines) {
+            agree(line);
+        }
+    }
+    SECTION("Random lines") {
+        const char alphabet[] = {' ', '\t', '"', '"', 'a', 'Z', '_', '0', '7', '-', '.'};
+        std::mt19937 rng(2024);
+        for (int i = 0; i < 3000; ++i) {
+            std::string line;
+            int length = rng() % 16;
+            for (int j = 0; j < length; ++j) {
+                line += alphabet[rng() % sizeof(alphabet)];
+            }
+            agree(line);
+        }
+    }
+    SECTION("Huge removeInorder positions are rejected") {
+        AVL tree;
+        std::ostringstream output;
+        OutputSink sink(output);
+        tree.out = &sink;
+        processCommand("removeInorder 99999999999999999999999", tree);
+        sink.flush();
+        REQUIRE(output.str() == "unsuccessful\n");
+    }
+}
+
+TEST_CASE("Output sink buffers until flushed", "[output]") {
+    std::ostringstream output;
+    SECTION("Nothing reaches the stream before a flush") {
+        OutputSink sink(output);
+        AVL tree;
+        tree.out = &sink;
+        processCommand("insert \"Adam\" 12345678", tree);
+        processCommand("search 12345678", tree);
+        REQUIRE(output.str().empty());
+        sink.flush();
+        REQUIRE(output.str() == "successful\nAdam\n");
+    }
+    SECTION("Line-buffered sinks flush every line") {
+        OutputSink sink(output);
+        sink.lineBuffered = true;
+        sink.writeLine("one");
+        REQUIRE(output.str() == "one\n");
+    }
+    SECTION("A full buffer is flushed on its own") {
+        OutputSink sink(output, 8);
+        sink.write("1234");
+        REQUIRE(output.str().empty());
+        sink.write("5678");
+        REQUIRE(output.str() == "12345678");
+    }
+    SECTION("Raw text goes out right after what is buffered") {
+        OutputSink sink(output);
+        sink.write("a, ");
+        sink.writeRaw("b\n");
+        REQUIRE(output.str() == "a, b\n");
+        sink.writeLine("c");
+        REQUIRE(output.str() == "a, b\n");
+        sink.flush();
+        REQUIRE(output.str() == "a, b\nc\n");
+    }
+}
+
+TEST_CASE_METHOD(CapturedTree, "Bulk load builds a balanced tree", "[bulk]") {
+    tree.insertHelper("10000500", "Existing");
+
+    SECTION("Unsorted batches are merged with the existing nodes") {
+        std::vector<std::pair<uint32_t, std::string>> records;
+        for (uint32_t i = 0; i < 1000; ++i) {
+            records.emplace_back(10000000 + (i * 7919) % 1000, "Loaded");  // A permutation of 0..999
+        }
+        records.erase(std::remove_if(records.begin(), records.end(),
+                                     [](const std::pair<uint32_t, std::string>& r) { return r.first == 10000500; }),
+                      records.end());
+        REQUIRE(tree.bulkLoad(records));
+        REQUIRE(checkSubtree(tree, tree.root, -1, 1LL << 32) == 1000);
+        REQUIRE(tree.pool[tree.root].height == 10);  // ceil(log2(1001))
+    }
+    SECTION("Duplicates reject the whole batch") {
+        REQUIRE_FALSE(tree.bulkLoad({{10000001, "A"}, {10000001, "B"}}));
+        REQUIRE_FALSE(tree.bulkLoad({{10000001, "A"}, {10000500, "B"}}));
+        REQUIRE(tree.pool.liveNodes == 1);
+    }
+    SECTION("The load command reads NAME/ID lines from a file") {
+        const char* path = "bulk_load_test.txt";
+        {
+            std::ofstream file(path);
+            file << "\"Zed\" 20000000\n\n\"Amy Lee\" 00000001\n";
+        }
+        processCommand("load \"bulk_load_test.txt\"", tree);
+        processCommand("printInorder", tree);
+        processCommand("search \"Amy Lee\"", tree);
+        {
+            std::ofstream file(path);
+            file << "\"Bad1\" 30000000\n";
+        }
+        processCommand("load \"bulk_load_test.txt\"", tree);
+        processCommand("load \"missing_file.txt\"", tree);
+        std::remove(path);
+        sink.flush();
+        REQUIRE(output.str() == "successful\nsuccessful\nAmy Lee, Existing, Zed\n00000001\nunsuccessful\nunsuccessful\n");
+    }
+}
+
+// Global allocation counter for the allocation tests: counts heap blocks of one particular size.
+// Replacing operator new means replacing every form of it, or the library and sanitizers pair one
+// form's allocation with another form's release
+static size_t countedSize = 0;
+static size_t countedAllocations = 0;
+static void* countedAllocate(std::size_t size) noexcept {
+    if (size == countedSize) {
+        countedAllocations++;
+    }
+    return std::malloc(size == 0 ? 1 : size);
+}
+static void* countedAllocate(std::size_t size, std::align_val_t alignment) noexcept {
+    if (size == countedSize) {
+        countedAllocations++;
+    }
+    std::size_t align = static_cast<std::size_t>(alignment);
+    return std::aligned_alloc(align, (size + align - 1) / align * align);  // aligned_alloc wants a multiple of the alignment
+}
+void* operator new(std::size_t size) {
+    if (void* block = countedAllocate(size)) {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) {
+    if (void* block = countedAllocate(size)) {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    if (void* block = countedAllocate(size, alignment)) {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    if (void* block = countedAllocate(size, alignment)) {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size);
+}
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, alignment);
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, alignment);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"  // GCC can't tell these replace the defaults
+#endif
+// Every form above ends in malloc or aligned_alloc, so every form of delete is free
+void operator delete(void* block) noexcept {
+    std::free(block);
+}
+void operator delete[](void* block) noexcept {
+    std::free(block);
+}
+void operator delete(void* block, std::size_t) noexcept {
+    std::free(block);
+}
+void operator delete[](void* block, std::size_t) noexcept {
+    std::free(block);
+}
+void operator delete(void* block, std::align_val_t) noexcept {
+    std::free(block);
+}
+void operator delete[](void* block, std::align_val_t) noexcept {
+    std::free(block);
+}
+void operator delete(void* block, std::size_t, std::align_val_t) noexcept {
+    std::free(block);
+}
+void operator delete[](void* block, std::size_t, std::align_val_t) noexcept {
+    std::free(block);
+}
+void operator delete(void* block, const std::nothrow_t&) noexcept {
+    std::free(block);
+}
+void operator delete[](void* block, const std::nothrow_t&) noexcept {
+    std::free(block);
+}
+void operator delete(void* block, std::align_val_t, const std::nothrow_t&) noexcept {
+    std::free(block);
+}
+void operator delete[](void* block, std::align_val_t, const std::nothrow_t&) noexcept {
+    std::free(block);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+TEST_CASE_METHOD(CapturedTree, "Inserts copy the name exactly once", "[allocations]") {
+    // Names long enough to skip the small-string buffer; their heap block is length + 1 bytes.
+    // No other allocation on the insert path has that size
+    const std::string name(60, 'x');
+    const int inserts = 1000;
+    std::vector<std::string> lines;
+    for (int i = 0; i < inserts; ++i) {
+        lines.push_back("insert \"" + name + "\" " + formatId(10000000 + i));
+    }
+    processCommand(lines[0], tree);  // The name index keeps its own copy of each distinct name, made here
+    countedSize = name.size() + 1;
+    countedAllocations = 0;
+    for (int i = 1; i < inserts; ++i) {
+        processCommand(lines[i], tree);
+    }
+    processCommand(lines[0], tree);  // Duplicate: no allocation at all
+    countedSize = 0;
+    REQUIRE(countedAllocations == static_cast<size_t>(inserts - 1));
+}
+
+TEST_CASE_METHOD(CapturedTree, "Traversal iterators match the recursive traversals", "[traversal]") {
+    std::mt19937 rng(7);
+    for (int size = 0; size < 200; size += 13) {
+        while (static_cast<int>(tree.pool.liveNodes) < size) {
+            tree.insertHelper(formatId(10000000 + rng() % 100000), "Node");
+        }
+        std::vector<uint32_t> expected[3];
+        tree.inorderTraversal(tree.root, expected[0]);
+        tree.preorderTraversal(tree.root, expected[1]);
+        tree.postorderTraversal(tree.root, expected[2]);
+        const TraversalOrder orders[] = {TraversalOrder::Inorder, TraversalOrder::Preorder, TraversalOrder::Postorder};
+        for (int o = 0; o < 3; ++o) {
+            std::vector<uint32_t> streamed;
+            for (TreeIterator it = tree.traverse(orders[o]); !it.done(); it.next()) {
+                streamed.push_back(it.node());
+            }
+            REQUIRE(streamed == expected[o]);
+        }
+    }
+}
+
+TEST_CASE_METHOD(CapturedTree, "Level count and stats come from maintained counters", "[stats]") {
+    processCommand("printLevelCount", tree);
+    for (int i = 1; i <= 7; ++i) {
+        tree.insertHelper(formatId(i), "Node");
+    }
+    tree.removeHelper(formatId(7));
+    sink.flush();
+    output.str("");
+    processCommand("printLevelCount", tree);
+    processCommand("stats", tree);
+    sink.flush();
+    REQUIRE(output.str() == "3\nheight 3\nnodes 6\nnodes at height 1: 3\nnodes at height 2: 2\nnodes at height 3: 1\n");
+}
+
+TEST_CASE_METHOD(CapturedTree, "Range search streams the IDs in an interval", "[range]") {
+    for (int i = 0; i < 50; ++i) {
+        tree.insertHelper(formatId(10000000 + 2 * i), "Even");
+    }
+    sink.flush();
+    output.str("");
+    processCommand("searchRange 10000005 10000011", tree);
+    processCommand("searchRange 00000000 10000000", tree);
+    processCommand("searchRange 10000099 99999999", tree);
+    processCommand("searchRange 10000011 10000005", tree);
+    processCommand("searchRange 10000005", tree);
+    sink.flush();
+    REQUIRE(output.str() ==
+            "10000006 Even\n10000008 Even\n10000010 Even\n"
+            "10000000 Even\n"
+            "unsuccessful\n"
+            "unsuccessful\n");
+}
+
+TEST_CASE_METHOD(CapturedTree, "Nearest-ID lookups", "[nearest]") {
+    tree.insertHelper("00000010", "Ten");
+    tree.insertHelper("00000020", "Twenty");
+    tree.insertHelper("00000030", "Thirty");
+    sink.flush();
+    output.str("");
+    const char* commands[] = {
+        "floor 00000025", "floor 00000020", "floor 00000009",
+        "ceiling 00000011", "ceiling 00000030", "ceiling 00000031",
+        "next 00000020", "next 00000030", "prev 00000020", "prev 00000010", "prev 00000000",
+    };
+    for (const char* command : commands) {
+        processCommand(command, tree);
+    }
+    sink.flush();
+    REQUIRE(output.str() ==
+            "00000020 Twenty\n00000020 Twenty\nunsuccessful\n"
+            "00000020 Twenty\n00000030 Thirty\nunsuccessful\n"
+            "00000030 Thirty\nunsuccessful\n00000010 Ten\nunsuccessful\nunsuccessful\n");
+}
+
+TEST_CASE_METHOD(CapturedTree, "Rank and select commands", "[rank]") {
+    tree.insertHelper("00000030", "Thirty");
+    tree.insertHelper("00000010", "Ten");
+    tree.insertHelper("00000020", "Twenty");
+    sink.flush();
+    output.str("");
+    const char* commands[] = {"rank 00000010", "rank 00000030", "rank 00000015", "select 1", "select 3"};
+    for (const char* command : commands) {
+        processCommand(command, tree);
+    }
+    sink.flush();
+    REQUIRE(output.str() == "0\n2\nunsuccessful\n00000020 Twenty\nunsuccessful\n");
+}
+
+TEST_CASE_METHOD(CapturedTree, "Paginated inorder listing", "[page]") {
+    const char* names[] = {"A", "B", "C", "D", "E", "F", "G"};
+    for (int i = 0; i < 7; ++i) {
+        tree.insertHelper(formatId(i), names[i]);
+    }
+    sink.flush();
+    output.str("");
+    processCommand("printInorder 0 3", tree);
+    processCommand("printInorder 3 3", tree);
+    processCommand("printInorder 6 3", tree);
+    processCommand("printInorder 9 3", tree);
+    processCommand("printInorder 2 0", tree);
+    processCommand("printInorder 5", tree);  // A single number is the plain command
+    sink.flush();
+    REQUIRE(output.str() == "A, B, C\nD, E, F\nG\n\n\nA, B, C, D, E, F, G\n");
+}
+
+// Random trees over a shared ID range, so they overlap
+static std::map<uint32_t, std::string> randomEntries(std::mt19937& rng, size_t count, const std::string& name) {
+    std::map<uint32_t, std::string> entries;
+    while (entries.size() < count) {
+        entries.emplace(rng() % 40000, name);
+    }
+    return entries;
+}
+
+static AVL treeOf(const std::map<uint32_t, std::string>& entries) {
+    AVL tree;
+    REQUIRE(tree.bulkLoad(std::vector<std::pair<uint32_t, std::string>>(entries.begin(), entries.end())));
+    return tree;
+}
+
+TEST_CASE("Join-based set operations", "[setops]") {
+    std::mt19937 rng(2024);
+    for (unsigned threads : {1u, 4u}) {
+        for (size_t otherCount : {0, 10, 3000, 20000}) {
+            std::map<uint32_t, std::string> base = randomEntries(rng, 15000, "Base");
+            std::map<uint32_t, std::string> delta = randomEntries(rng, otherCount, "Delta");
+            AVL other = treeOf(delta);
+
+            std::map<uint32_t, std::string> expected = delta;
+            for (const auto& entry : base) {
+                expected[entry.first] = entry.second;  // The receiving tree's entry wins
+            }
+            AVL merged = treeOf(base);
+            merged.threads = threads;
+            merged.unionWith(other);
+            checkAgainst(merged, expected);
+
+            expected.clear();
+            for (const auto& entry : base) {
+                if (delta.count(entry.first)) {
+                    expected.insert(entry);
+                }
+            }
+            AVL common = treeOf(base);
+            common.threads = threads;
+            common.intersectWith(other);
+            checkAgainst(common, expected);
+
+            expected.clear();
+            for (const auto& entry : base) {
+                if (!delta.count(entry.first)) {
+                    expected.insert(entry);
+                }
+            }
+            AVL rest = treeOf(base);
+            rest.threads = threads;
+            rest.differenceWith(other);
+            checkAgainst(rest, expected);
+            checkAgainst(other, delta);  // The other tree is only read
+        }
+    }
+
+    AVL tree = treeOf({{1, "A"}, {2, "B"}, {3, "C"}});
+    tree.unionWith(tree);
+    tree.intersectWith(tree);
+    checkAgainst(tree, {{1, "A"}, {2, "B"}, {3, "C"}});
+    tree.differenceWith(tree);
+    checkAgainst(tree, {});
+}
+
+TEST_CASE("Split and join keep the tree balanced", "[setops]") {
+    std::map<uint32_t, std::string> entries;
+    for (uint32_t id = 0; id < 1000; id += 2) {
+        entries.emplace(id, "Even");
+    }
+    AVL tree = treeOf(entries);
+    uint32_t left = nullIndex, found = nullIndex, right = nullIndex;
+    tree.split(tree.root, 500, left, found, right);
+    REQUIRE(tree.pool[found].id == 500);
+    REQUIRE(checkSubtree(tree, left, -1, 500) == 250);
+    REQUIRE(checkSubtree(tree, right, 500, 1000) == 249);
+    tree.root = tree.join(left, found, right);
+    REQUIRE(checkSubtree(tree, tree.root, -1, 1000) == 500);
+
+    tree.split(tree.root, 9, left, found, right);  // Not in the tree
+    REQUIRE(found == nullIndex);
+    REQUIRE(checkSubtree(tree, left, -1, 9) == 5);
+    tree.root = tree.joinPair(left, right);  // Very different heights
+    checkAgainst(tree, entries);
+}
+
+// Scaling benchmark: merge a delta into a large base tree with 1, 2, 4 and 8 threads.
+// Hidden; run with ./Tests "[.benchmark]"
+TEST_CASE("Set operation scaling", "[.benchmark]") {
+    std::vector<std::pair<uint32_t, std::string>> base, delta;
+    for (uint32_t id = 0; id < 4000000; id++) {
+        base.emplace_back(id * 4, "Base");
+    }
+    for (uint32_t id = 0; id < 1000000; id++) {
+        delta.emplace_back(id * 16 + 1, "Delta");
+    }
+    AVL baseTree, deltaTree;
+    REQUIRE(baseTree.bulkLoad(base));
+    REQUIRE(deltaTree.bulkLoad(delta));
+    for (unsigned threads : {1u, 2u, 4u, 8u}) {
+        for (int operation = 0; operation < 3; operation++) {
+            AVL tree = baseTree;
+            tree.threads = threads;
+            auto start = std::chrono::steady_clock::now();
+            if (operation == 0) {
+                tree.unionWith(deltaTree);
+            } else if (operation == 1) {
+                tree.intersectWith(deltaTree);
+            } else {
+                tree.differenceWith(deltaTree);
+            }
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            const char* names[] = {"union", "intersection", "difference"};
+            std::cout << names[operation] << " threads=" << threads << ": " << elapsed.count() << " ms\n";
+        }
+    }
+}
+
+TEST_CASE("Batched inserts match line-by-line processing", "[batch]") {
+    std::mt19937 rng(99);
+    const std::string names[] = {"Ann", "Bob Lee", "C3PO", ""};
+    std::vector<std::string> lines;
+    for (int step = 0; step < 5000; ++step) {
+        int op = rng() % 10;
+        std::string id = formatId(rng() % 3000);
+        if (op < 7) {
+            if (rng() % 50 == 0) {
+                id = "123";  // Invalid ID
+            }
+            lines.push_back("insert \"" + names[rng() % 4] + "\" " + id);
+        } else if (op == 7) {
+            lines.push_back("remove " + id);
+        } else if (op == 8) {
+            lines.push_back("search \"Ann\"");
+        } else {
+            lines.push_back("removeInorder " + std::to_string(rng() % 100));
+        }
+    }
+    lines.push_back("printInorder");
+    lines.push_back("printPreorder");
+
+    AVL single, batched;
+    std::ostringstream singleOutput, batchedOutput;
+    OutputSink singleSink(singleOutput), batchedSink(batchedOutput);
+    single.out = &singleSink;
+    batched.out = &batchedSink;
+    for (const std::string& line : lines) {
+        processCommand(line, single);
+    }
+    for (size_t start = 0; start < lines.size(); start += 700) {  // Chunks like main reads them
+        std::vector<std::string> chunk(lines.begin() + start, lines.begin() + std::min(lines.size(), start + 700));
+        processCommands(chunk, chunk.size(), batched);
+    }
+    singleSink.flush();
+    batchedSink.flush();
+    // Preorder depends on the shape, which the merge is free to choose
+    std::string expected = singleOutput.str();
+    std::string actual = batchedOutput.str();
+    expected.erase(expected.rfind('\n', expected.size() - 2) + 1);
+    actual.erase(actual.rfind('\n', actual.size() - 2) + 1);
+    REQUIRE(actual == expected);
+    checkAgainst(batched, entriesOf(single));
+}
+
+TEST_CASE("Finger inserts build the same tree as root descents", "[finger]") {
+    std::mt19937 rng(7);
+    AVL finger, descent;
+    std::ostringstream fingerOutput, descentOutput;
+    OutputSink fingerSink(fingerOutput), descentSink(descentOutput);
+    finger.out = &fingerSink;
+    descent.out = &descentSink;
+    uint32_t next = 0;
+    for (int step = 0; step < 20000; ++step) {
+        int op = rng() % 20;
+        std::string line;
+        if (op < 12) {
+            line = "insert \"A\" " + formatId(next++);  // Mostly increasing IDs
+        } else if (op < 16) {
+            line = "insert \"B\" " + formatId(rng() % (next + 1));  // Random, often duplicates
+        } else if (op < 18) {
+            line = "remove " + formatId(rng() % (next + 1));
+        } else if (op == 18) {
+            line = "removeInorder " + std::to_string(rng() % 50);
+        } else {
+            line = "insert \"C\" " + formatId(next + 1000 - rng() % 2000);
+        }
+        processCommand(line, finger);
+        descent.fingerValid = false;  // Forces the plain descent from the root
+        processCommand(line, descent);
+    }
+    processCommand("printPreorder", finger);
+    processCommand("printPreorder", descent);
+    fingerSink.flush();
+    descentSink.flush();
+    REQUIRE(fingerOutput.str() == descentOutput.str());
+    std::vector<uint32_t> fingerNodes, descentNodes;
+    finger.preorderTraversal(finger.root, fingerNodes);
+    descent.preorderTraversal(descent.root, descentNodes);
+    REQUIRE(fingerNodes.size() == descentNodes.size());
+    for (size_t i = 0; i < fingerNodes.size(); ++i) {
+        REQUIRE(finger.pool[fingerNodes[i]].id == descent.pool[descentNodes[i]].id);
+    }
+    checkSubtree(finger, finger.root, -1, 1LL << 32);
+}
+
+// Ingest benchmark: sequential versus random IDs, with and without the finger.
+// Hidden; run with ./Tests "[.benchmark]"
+TEST_CASE("Sequential and random ingest", "[.benchmark]") {
+    const uint32_t count = 2000000;
+    std::vector<uint32_t> sequential(count);
+    for (uint32_t i = 0; i < count; i++) {
+        sequential[i] = i;
+    }
+    std::vector<uint32_t> shuffled = sequential;
+    std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(1));
+    std::vector<std::string> names(count);
+    for (uint32_t i = 0; i < count; i++) {
+        for (uint32_t rest = i; rest > 0 || names[i].empty(); rest /= 26) {
+            names[i] += static_cast<char>('a' + rest % 26);  // Distinct names, like real data: every insert adds a name to the index map
+        }
+    }
+    for (bool useFinger : {true, false}) {
+        for (const std::vector<uint32_t>* ids : {&sequential, &shuffled}) {
+            AVL tree;
+            bool flag = false;
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t id : *ids) {
+                tree.fingerValid = tree.fingerValid && useFinger;
+                tree.root = tree.insert(tree.root, names[id], id, flag);
+            }
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            std::cout << (ids == &sequential ? "sequential" : "random") << (useFinger ? " with finger: " : " from root: ")
+                      << elapsed.count() << " ms\n";
+        }
+    }
+}
+
+// Check a persistent subtree's ordering, heights, sizes and balance; returns its size
+static uint32_t checkPersistent(const PersistentRef& node, long long low, long long high) {
+    if (!node) {
+        return 0;
+    }
+    REQUIRE(node->id > low);
+    REQUIRE(node->id < high);
+    uint32_t size = 1 + checkPersistent(node->left, low, node->id) + checkPersistent(node->right, node->id, high);
+    int leftHeight = node->left ? node->left->height : 0;
+    int rightHeight = node->right ? node->right->height : 0;
+    REQUIRE(node->height == 1 + std::max(leftHeight, rightHeight));
+    REQUIRE(std::abs(leftHeight - rightHeight) <= 1);
+    REQUIRE(node->size == size);
+    return size;
+}
+
+static void collectNodes(const PersistentRef& node, std::unordered_set<const PersistentNode*>& nodes) {
+    if (node) {
+        nodes.insert(node.get());
+        collectNodes(node->left, nodes);
+        collectNodes(node->right, nodes);
+    }
+}
+
+TEST_CASE("Persistent snapshots stay frozen", "[persistent]") {
+    PersistentAVL tree;
+    std::map<uint32_t, std::string> current;
+    std::mt19937 rng(31);
+    for (int i = 0; i < 2000; ++i) {
+        uint32_t id = rng() % 5000;
+        REQUIRE(tree.insert(id, "Old") == current.emplace(id, "Old").second);
+    }
+    Snapshot frozen = tree.snapshot();
+    std::map<uint32_t, std::string> frozenEntries = current;
+    for (int i = 0; i < 4000; ++i) {
+        uint32_t id = rng() % 5000;
+        if (rng() % 2) {
+            REQUIRE(tree.insert(id, "New") == current.emplace(id, "New").second);
+        } else {
+            REQUIRE(tree.remove(id) == (current.erase(id) == 1));
+        }
+    }
+    REQUIRE(checkPersistent(frozen.root, -1, 1LL << 32) == frozenEntries.size());
+    for (const auto& entry : frozenEntries) {
+        REQUIRE(*frozen.find(entry.first)->name == entry.second);
+    }
+    Snapshot latest = tree.snapshot();
+    REQUIRE(checkPersistent(latest.root, -1, 1LL << 32) == current.size());
+    for (const auto& entry : current) {
+        REQUIRE(*latest.find(entry.first)->name == entry.second);
+    }
+
+    // One insert copies only the path to the new node (plus a rotation's worth of nodes)
+    REQUIRE(tree.insert(9999, "Path"));
+    std::unordered_set<const PersistentNode*> before, after;
+    collectNodes(latest.root, before);
+    collectNodes(tree.snapshot().root, after);
+    size_t copied = 0;
+    for (const PersistentNode* node : after) {
+        copied += before.count(node) == 0;
+    }
+    REQUIRE(copied <= static_cast<size_t>(latest.height()) + 3);
+    for (const PersistentNode* node : after) {
+        const PersistentNode* old = latest.find(node->id);
+        REQUIRE((old == nullptr || old->name == node->name));  // Copies share the name instead of duplicating it
+    }
+
+    // A version is freed once the last snapshot of it is gone
+    std::weak_ptr<const PersistentNode> oldRoot = frozen.root;
+    frozen = Snapshot();
+    REQUIRE(oldRoot.expired());
+}
+
+TEST_CASE("Persistent snapshots can be read while writes continue", "[persistent]") {
+    PersistentAVL tree;
+    for (uint32_t id = 0; id < 500; ++id) {
+        tree.insert(id, "A");
+    }
+    Snapshot frozen = tree.snapshot();
+    std::ostringstream expected;
+    OutputSink expectedSink(expected);
+    frozen.printInorder(expectedSink);
+    expectedSink.flush();
+    std::thread reader([&frozen, &expected] {
+        for (int pass = 0; pass < 50; ++pass) {
+            std::ostringstream output;
+            OutputSink sink(output);
+            frozen.printInorder(sink);
+            sink.flush();
+            if (output.str() != expected.str()) {
+                throw std::runtime_error("snapshot changed");  // Fails the test through std::terminate
+            }
+        }
+    });
+    for (uint32_t id = 0; id < 2000; ++id) {
+        tree.remove(id);
+        tree.insert(id + 1000, "B");
+    }
+    reader.join();
+    REQUIRE(tree.snapshot().size() == 1000);  // 2000..2999
+    REQUIRE(frozen.size() == 500);
+}
+
+TEST_CASE("Concurrent tree under readers and writers", "[concurrent]") {
+    ConcurrentAVL tree;
+    std::atomic<int> failures(0);  // Catch assertions are only used on the main thread
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&tree, &failures, t] {
+            // Each writer owns the IDs equal to t modulo 4, so the final contents are known
+            const char* expected = t % 2 ? "Odd" : "Even";
+            for (uint32_t i = 0; i < 3000; ++i) {
+                uint32_t id = i * 4 + t;
+                std::string name;
+                failures += !tree.insert(id, expected);
+                failures += !tree.searchId(id, name) || name != expected;
+                if (i % 3 == 0) {
+                    failures += !tree.remove(id);
+                }
+            }
+        });
+    }
+    threads.emplace_back([&tree] {
+        for (int pass = 0; pass < 200; ++pass) {
+            std::ostringstream output;
+            OutputSink sink(output);
+            tree.printInorder(sink);
+            tree.levelCount();
+            tree.searchName("Odd");
+        }
+    });
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(failures == 0);
+    REQUIRE(tree.size() == 8000);
+    std::vector<uint32_t> odd = tree.searchName("Odd");
+    REQUIRE(odd.size() == 4000);
+    REQUIRE(std::is_sorted(odd.begin(), odd.end()));
+    AVL copy = tree.copy();
+    REQUIRE(checkSubtree(copy, copy.root, -1, 1LL << 32) == 8000);
+    REQUIRE_FALSE(tree.insert(5, "Bad1"));
+    REQUIRE(tree.removeInorder(0));
+    REQUIRE_FALSE(tree.removeInorder(7999));
+}
+
+// Throughput of a concurrent tree at a read/write mix: reads are searchId, writes an insert or a remove
+template <class Tree>
+static double mixedThroughput(unsigned threadCount, int readPercent) {
+    const uint32_t keys = 1000000;
+    const int operationsPerThread = 500000;
+    Tree tree;
+    for (uint32_t id = 0; id < keys; id += 2) {
+        tree.insert(id, "Name");
+    }
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&tree, t, readPercent, keys, operationsPerThread] {
+            std::mt19937 rng(t);
+            std::string name;
+            for (int i = 0; i < operationsPerThread; ++i) {
+                uint32_t id = rng() % keys;
+                if (static_cast<int>(rng() % 100) < readPercent) {
+                    tree.searchId(id, name);
+                } else if (rng() % 2) {
+                    tree.insert(id, "Name");
+                } else {
+                    tree.remove(id);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return threadCount * operationsPerThread / elapsed.count() / 1e6;
+}
+
+// Read scaling of the reader-writer lock at 90/10 and 99/1 read/write mixes with 1 to 8 threads.
+// This is the baseline the other concurrency schemes are compared with. Hidden; run with ./Tests "[.benchmark]"
+TEST_CASE("Reader-writer tree scaling", "[.benchmark]") {
+    for (int readPercent : {90, 99}) {
+        for (unsigned threadCount : {1u, 2u, 4u, 8u}) {
+            std::cout << readPercent << "% reads, " << threadCount << " threads: "
+                      << mixedThroughput<ConcurrentAVL>(threadCount, readPercent) << " Mops/s\n";
+        }
+    }
+}
+
+TEST_CASE("Optimistic reads never miss an ID that stays in the tree", "[optimistic]") {
+    OptimisticAVL tree;
+    std::map<uint32_t, std::string> reference;
+    std::mt19937 rng(5);
+    for (int step = 0; step < 20000; ++step) {
+        uint32_t id = rng() % 3000;
+        if (rng() % 2) {
+            REQUIRE(tree.insert(id, "A") == reference.emplace(id, "A").second);
+        } else {
+            REQUIRE(tree.remove(id) == (reference.erase(id) == 1));
+        }
+    }
+    REQUIRE(tree.size() == reference.size());
+    std::string name;
+    for (uint32_t id = 0; id < 3000; ++id) {
+        REQUIRE(tree.searchId(id, name) == (reference.count(id) == 1));
+    }
+
+    // Even IDs stay put while writers churn the odd ones, forcing rotations and successor moves around them
+    OptimisticAVL churned;
+    for (uint32_t id = 0; id < 20000; id += 2) {
+        churned.insert(id, "Stay");
+    }
+    std::atomic<bool> stop(false);
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < 2; ++t) {
+        threads.emplace_back([&churned, &stop, t] {
+            std::mt19937 writerRng(t);
+            while (!stop) {
+                uint32_t id = writerRng() % 10000 * 2 + 1;
+                churned.insert(id, "Churn");
+                churned.remove(writerRng() % 10000 * 2 + 1);
+            }
+        });
+    }
+    for (unsigned t = 0; t < 3; ++t) {
+        threads.emplace_back([&churned, &failures, t] {
+            std::mt19937 readerRng(100 + t);
+            std::string found;
+            for (int i = 0; i < 200000; ++i) {
+                uint32_t id = readerRng() % 20000;
+                bool present = churned.searchId(id, found);
+                if (id % 2 == 0) {
+                    failures += !present || found != "Stay";
+                } else {
+                    failures += present && found != "Churn";
+                }
+            }
+        });
+    }
+    for (size_t t = 2; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+    stop = true;
+    threads[0].join();
+    threads[1].join();
+    REQUIRE(failures == 0);
+}
+
+// The optimistic tree against the reader-writer lock baseline at the same mixes.
+// Hidden; run with ./Tests "[.benchmark]"
+TEST_CASE("Optimistic tree scaling", "[.benchmark]") {
+    for (int readPercent : {90, 99}) {
+        for (unsigned threadCount : {1u, 2u, 4u, 8u}) {
+            std::cout << readPercent << "% reads, " << threadCount << " threads: optimistic "
+                      << mixedThroughput<OptimisticAVL>(threadCount, readPercent) << " Mops/s, locked "
+                      << mixedThroughput<ConcurrentAVL>(threadCount, readPercent) << " Mops/s\n";
+        }
+    }
+}
+
+// Objects for the reclamation stress test; liveObjects[serial] is cleared when one is freed
+static std::atomic<bool> liveObjects[1 << 18];
+struct Tracked {
+    uint32_t serial;
+    explicit Tracked(uint32_t serial) : serial(serial) { liveObjects[serial] = true; }
+    ~Tracked() { liveObjects[serial] = false; }
+};
+
+TEST_CASE("Epoch reclamation under remove churn", "[epoch]") {
+    SECTION("Readers never see a freed object") {
+        EpochManager epochs;
+        const int slotCount = 64;
+        std::atomic<Tracked*> slots[slotCount];
+        std::atomic<uint32_t> serials(0);
+        for (auto& slot : slots) {
+            slot = new Tracked(serials++);
+        }
+        std::atomic<bool> stop(false);
+        std::atomic<int> failures(0);
+        std::atomic<size_t> worstPending(0);
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < 2; ++t) {
+            threads.emplace_back([&, t] {  // Writers: swap an object out and retire it
+                std::mt19937 rng(t);
+                while (serials < (1 << 18) - 100) {
+                    Tracked* old = slots[rng() % slotCount].exchange(new Tracked(serials++));
+                    epochs.retire(old);
+                    size_t pending = epochs.pending();
+                    size_t worst = worstPending;
+                    while (pending > worst && !worstPending.compare_exchange_weak(worst, pending)) {
+                    }
+                }
+                stop = true;
+            });
+        }
+        for (unsigned t = 0; t < 3; ++t) {
+            threads.emplace_back([&, t] {  // Readers: anything loaded inside a guard must stay alive
+                std::mt19937 rng(10 + t);
+                while (!stop) {
+                    EpochManager::Guard guard(epochs);
+                    Tracked* object = slots[rng() % slotCount].load();
+                    for (int spin = 0; spin < 50; ++spin) {
+                        failures += !liveObjects[object->serial];
+                    }
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        REQUIRE(failures == 0);
+        REQUIRE(epochs.epoch() > 2);  // Garbage really was being freed along the way
+        REQUIRE(worstPending <= 2 * EpochManager::maxPending);  // Two writers, each with a bounded list
+        for (auto& slot : slots) {
+            delete slot.load();
+        }
+    }
+    SECTION("The optimistic tree frees removed nodes as it goes") {
+        OptimisticAVL tree;
+        for (uint32_t id = 0; id < 4000; id += 2) {
+            tree.insert(id, "Stay");
+        }
+        std::atomic<bool> stop(false);
+        std::atomic<int> failures(0);
+        std::thread writer([&] {
+            for (int round = 0; round < 100000; ++round) {
+                uint32_t id = round % 2000 * 2 + 1;
+                tree.insert(id, "Churn");
+                tree.remove(id);
+            }
+            stop = true;
+        });
+        std::vector<std::thread> readers;
+        for (unsigned t = 0; t < 3; ++t) {
+            readers.emplace_back([&, t] {
+                std::mt19937 rng(t);
+                std::string name;
+                while (!stop) {
+                    uint32_t id = rng() % 2000 * 2;
+                    failures += !tree.searchId(id, name) || name != "Stay";
+                }
+            });
+        }
+        writer.join();
+        for (std::thread& reader : readers) {
+            reader.join();
+        }
+        REQUIRE(failures == 0);
+        REQUIRE(tree.size() == 2000);
+        REQUIRE(tree.garbage() <= EpochManager::maxPending);  // 100000 removals, at most one list's worth left
+    }
+    SECTION("Exited threads hand back their records and garbage") {
+        EpochManager epochs;
+        std::atomic<uint32_t> serials(0);
+        auto retireSome = [&epochs, &serials](int count) {
+            for (int i = 0; i < count; ++i) {
+                epochs.retire(new Tracked(serials++));
+            }
+        };
+        // One thread after another: each takes over the record, retired list included, that the last one left
+        for (int t = 0; t < 200; ++t) {
+            std::thread(retireSome, 20).join();
+        }
+        REQUIRE(epochs.recordCount() == 1);
+        REQUIRE(epochs.pending() < EpochManager::maxPending);  // 4000 retired, most of them freed since
+
+        // Threads alive at once need records of their own; once they are gone, a retiring thread adopts their lists
+        std::atomic<int> ready(0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&] {
+                retireSome(20);
+                ready++;
+                while (ready < 4) {
+                    std::this_thread::yield();
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        REQUIRE(epochs.recordCount() == 4);
+        uint32_t orphaned = serials;
+        retireSome(4 * EpochManager::collectThreshold);
+        REQUIRE(epochs.recordCount() == 4);
+        int stillLive = 0;
+        for (uint32_t serial = 0; serial < orphaned; ++serial) {
+            stillLive += liveObjects[serial];
+        }
+        REQUIRE(stillLive == 0);
+    }
+}
+
+TEST_CASE("Sharded tree answers like a single tree", "[sharded]") {
+    ShardedAVL sharded(10, 64);  // Small shards split early
+    AVL single;
+    std::ostringstream shardedOutput, singleOutput;
+    OutputSink shardedSink(shardedOutput), singleSink(singleOutput);
+    single.out = &singleSink;
+    std::mt19937 rng(17);
+    const std::string names[] = {"Ann", "Bob", "Bad1"};
+    int levelChecks = 0;
+    for (int step = 0; step < 6000; ++step) {
+        // Mostly IDs below 1000, so shard 0 keeps outgrowing the rest and has to be re-split
+        uint32_t id = rng() % 8 == 0 ? rng() % 100000000 : rng() % 1000;
+        std::string line;
+        switch (rng() % 8) {
+            case 0: case 1: case 2:
+                line = "insert \"" + names[rng() % 3] + "\" " + formatId(id);
+                break;
+            case 3:
+                line = "remove " + formatId(id);
+                break;
+            case 4:
+                line = "search " + formatId(id);
+                break;
+            case 5:
+                line = "search \"Ann\"";
+                break;
+            case 6:
+                line = "removeInorder " + std::to_string(rng() % 600);
+                break;
+            default:
+                switch (rng() % 20) {
+                    case 0:
+                        line = "printInorder";
+                        break;
+                    case 1:
+                        line = "printLevelCount";
+                        break;
+                    default:
+                        line = "insert \"Cy\" " + formatId(id);
+                        break;
+                }
+                break;
+        }
+        if (line == "printLevelCount") {
+            // The single tree's height depends on its insert history, so both answers are held to the
+            // heights an AVL with this many entries can have: from perfectly balanced up to the sparsest AVL
+            std::ostringstream shardedLevels, singleLevels;
+            OutputSink shardedLevelSink(shardedLevels), singleLevelSink(singleLevels);
+            sharded.execute(line, shardedLevelSink);
+            single.out = &singleLevelSink;
+            processCommand(line, single);
+            single.out = &singleSink;
+            shardedLevelSink.flush();
+            singleLevelSink.flush();
+            uint64_t entries = single.pool.liveNodes;
+            int lowest = 0;
+            while ((uint64_t(1) << lowest) <= entries) {
+                lowest++;
+            }
+            int highest = 0;
+            for (uint64_t sparsest = 0, previous = 0; sparsest <= entries; highest++) {
+                uint64_t next = sparsest + previous + 1;  // Fewest entries in an AVL one level taller
+                previous = sparsest;
+                sparsest = next;
+            }
+            highest--;
+            for (int levels : {std::stoi(shardedLevels.str()), std::stoi(singleLevels.str())}) {
+                REQUIRE(levels >= lowest);
+                REQUIRE(levels <= highest);
+            }
+            levelChecks++;
+            continue;
+        }
+        sharded.execute(line, shardedSink);
+        processCommand(line, single);
+    }
+    REQUIRE(levelChecks > 0);
+    sharded.execute("printInorder", shardedSink);
+    processCommand("printInorder", single);
+    shardedSink.flush();
+    singleSink.flush();
+    REQUIRE(shardedOutput.str() == singleOutput.str());
+    REQUIRE(sharded.size() == single.pool.liveNodes);
+    REQUIRE(sharded.shardCount() > 10);
+}
+
+TEST_CASE("Sharded level count matches a single tree where the shape is fixed", "[sharded]") {
+    ShardedAVL sharded(4, 1000000);  // Four fixed ranges of 25000000 IDs, never re-split
+    AVL single;
+    std::ostringstream shardedOutput, singleOutput;
+    OutputSink shardedSink(shardedOutput), singleSink(singleOutput);
+    single.out = &singleSink;
+    std::vector<std::string> lines = {"printLevelCount", "insert \"A\" 00000001", "printLevelCount",
+                                      "insert \"B\" 30000000", "printLevelCount",  // Two shards, two levels
+                                      "insert \"C\" 55000000", "insert \"D\" 80000000", "printLevelCount",
+                                      "remove 00000001", "remove 30000000", "remove 55000000", "remove 80000000"};
+    for (int id = 0; id < 7; ++id) {
+        lines.push_back("insert \"Low\" " + formatId(id));  // A perfect tree of 3 levels in the first shard
+    }
+    lines.push_back("insert \"High\" 60000000");
+    lines.push_back("printLevelCount");
+    for (int id = 0; id < 7; ++id) {
+        lines.push_back("remove " + formatId(id));
+    }
+    lines.push_back("printLevelCount");  // One entry left, in the third shard
+    lines.push_back("remove 60000000");
+    lines.push_back("printLevelCount");
+    for (const std::string& line : lines) {
+        sharded.execute(line, shardedSink);
+        processCommand(line, single);
+    }
+    shardedSink.flush();
+    singleSink.flush();
+    REQUIRE(shardedOutput.str() == singleOutput.str());
+    std::istringstream answers(shardedOutput.str());
+    std::vector<std::string> levels;
+    for (std::string answer; std::getline(answers, answer);) {
+        if (answer != "successful") {
+            levels.push_back(answer);
+        }
+    }
+    REQUIRE(levels == std::vector<std::string>{"0", "1", "2", "3", "4", "1", "0"});
+
+    // With one shard the sharded tree is a single AVL, so the level count is the same under any history
+    ShardedAVL oneShard(1, 1000000);
+    AVL reference;
+    std::mt19937 rng(5);
+    for (int step = 0; step < 3000; ++step) {
+        uint32_t id = rng() % 2000;
+        if (rng() % 3 == 0) {
+            bool removed = false;
+            oneShard.remove(id);
+            reference.root = reference.removeNode(reference.root, id, removed);
+        } else {
+            bool duplicate = false;
+            oneShard.insert(id, "One");
+            reference.root = reference.insert(reference.root, "One", id, duplicate);
+        }
+        REQUIRE(oneShard.levelCount() == reference.pool[reference.root].height);
+    }
+}
+
+TEST_CASE("Sharded tree takes writers in parallel", "[sharded]") {
+    ShardedAVL sharded(4, 256);
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&sharded, &failures, t] {
+            std::ostringstream output;
+            OutputSink sink(output);
+            for (uint32_t i = 0; i < 2000; ++i) {
+                uint32_t id = i * 4 + t;  // Every thread hits every shard
+                std::string name;
+                failures += !sharded.insert(id, "Shard");
+                failures += !sharded.searchId(id, name);
+                if (i % 2) {
+                    failures += !sharded.remove(id);
+                }
+                if (i % 500 == 0) {
+                    sharded.execute("printLevelCount", sink);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(failures == 0);
+    REQUIRE(sharded.size() == 4000);
+    REQUIRE(sharded.searchName("Shard").size() == 4000);
+}
+
+TEST_CASE("Parallel prints match serial prints byte for byte", "[print]") {
+    auto printed = [](AVL& tree, TraversalOrder order, bool parallel) {
+        std::ostringstream output;
+        OutputSink sink(output);
+        tree.out = &sink;
+        if (parallel) {
+            tree.printParallel(order);
+        } else {
+            tree.printNodesWithCommas(tree.traverse(order));
+        }
+        sink.flush();
+        return output.str();
+    };
+    const TraversalOrder orders[] = {TraversalOrder::Inorder, TraversalOrder::Preorder, TraversalOrder::Postorder};
+
+    AVL empty;
+    empty.threads = 4;
+    for (TraversalOrder order : orders) {
+        REQUIRE(printed(empty, order, true) == "\n");
+    }
+
+    // Sizes around the split depth, plus one big enough for printOrder to go parallel by itself
+    for (uint32_t size : {1u, 2u, 7u, 33u, 1000u, AVL::parallelPrintSize + 123}) {
+        std::vector<std::pair<uint32_t, std::string>> entries;
+        for (uint32_t id = 0; id < size; id++) {
+            entries.emplace_back(id * 3, std::string(1 + id % 13, char('a' + id % 26)));  // Names of many lengths
+        }
+        AVL tree;
+        REQUIRE(tree.bulkLoad(entries));
+        for (uint32_t id = 0; id < size; id += 5) {
+            bool duplicate = false;
+            tree.root = tree.insert(tree.root, "Extra", id * 3 + 1, duplicate);  // Uneven subtrees
+        }
+        for (unsigned threads : {1u, 3u, 8u}) {
+            tree.threads = threads;
+            for (TraversalOrder order : orders) {
+                REQUIRE(printed(tree, order, true) == printed(tree, order, false));
+            }
+        }
+    }
+
+    // The command path picks the parallel print for big trees and still prints the same line
+    AVL tree;
+    for (uint32_t id = 0; id < AVL::parallelPrintSize; id++) {
+        bool duplicate = false;
+        tree.root = tree.insert(tree.root, id % 2 ? "Odd" : "Even Name", id, duplicate);
+    }
+    std::ostringstream serial, parallel;
+    OutputSink serialSink(serial), parallelSink(parallel);
+    tree.out = &serialSink;
+    tree.printPostOrderHelper();
+    serialSink.flush();
+    tree.threads = 4;
+    tree.out = &parallelSink;
+    tree.printPostOrderHelper();
+    parallelSink.flush();
+    REQUIRE(serial.str() == parallel.str());
+}
+
+TEST_CASE("Parallel print scaling", "[.benchmark]") {
+    std::vector<std::pair<uint32_t, std::string>> entries;
+    for (uint32_t id = 0; id < 4000000; id++) {
+        entries.emplace_back(id, std::string(4 + id % 12, 'x'));
+    }
+    AVL tree;
+    REQUIRE(tree.bulkLoad(entries));
+    for (unsigned threads : {1u, 2u, 4u, 8u}) {
+        std::ostringstream output;
+        OutputSink sink(output);
+        tree.out = &sink;
+        tree.threads = threads;
+        auto start = std::chrono::steady_clock::now();
+        tree.printInOrderHelper();
+        sink.flush();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "print threads=" << threads << ": " << elapsed.count() << " ms (" << output.str().size() << " bytes)\n";
+    }
+}